@@ -0,0 +1,48 @@
+#ifndef CANOPY_NOTIFICATION_HISTORY_H
+#define CANOPY_NOTIFICATION_HISTORY_H
+
+#include <glib.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * Read-only view of the notification history ring written by CanopyWM
+ * ($XDG_STATE_HOME/canopy/notifications.ring). The layout must match
+ * CanopyWM/include/notification_history.h.
+ */
+#define NOTIFICATION_HISTORY_FILE "notifications.ring"
+#define NOTIFICATION_HISTORY_MAGIC 0x31484e43u /* "CNH1" */
+#define NOTIFICATION_HISTORY_VERSION 1
+#define NOTIFICATION_HISTORY_APP_LEN 64
+#define NOTIFICATION_HISTORY_SUMMARY_LEN 256
+#define NOTIFICATION_HISTORY_BODY_LEN 1024
+
+typedef struct {
+    _Atomic uint64_t seq;
+    int64_t timestamp;
+    uint32_t urgency;
+    char app_name[NOTIFICATION_HISTORY_APP_LEN];
+    char summary[NOTIFICATION_HISTORY_SUMMARY_LEN];
+    char body[NOTIFICATION_HISTORY_BODY_LEN];
+} NotificationHistoryRecord;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    _Atomic uint64_t head;
+} NotificationHistoryHeader;
+
+gboolean notification_history_open(void);
+void notification_history_close(void);
+
+/* Copy up to max of the newest records into out, newest first.
+   Returns the number of records copied. */
+guint notification_history_last(NotificationHistoryRecord *out, guint max);
+
+/* Like notification_history_last(), but only records from app_name. */
+guint notification_history_find_by_app(const char *app_name,
+                                       NotificationHistoryRecord *out, guint max);
+
+#endif
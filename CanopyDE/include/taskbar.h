@@ -10,6 +10,7 @@ typedef struct _TaskbarWindow {
     GtkWidget *button;  /* The taskbar button widget */
     gchar *title;       /* The window title */
     gboolean active;    /* TRUE if this window is active */
+    gboolean urgent;    /* TRUE if the window asked for attention */
 } TaskbarWindow;
 
 /* Structure representing the taskbar itself */
@@ -21,11 +22,12 @@ typedef struct _Taskbar {
 
 /* Function declarations */
 GtkWidget *taskbar_new(void);
-void taskbar_add_window(Window window);
+void taskbar_add_window(Window window, const char *title);
 void taskbar_remove_window(Window window);
-void taskbar_update_window_title(Window window);
+void taskbar_set_window_title(Window window, const char *title);
+void taskbar_set_window_urgent(Window window, gboolean urgent);
 void taskbar_set_active_window(Window window);
-void taskbar_update(GtkWidget *taskbar_widget);
+void taskbar_clear(void);
 void taskbar_cleanup(void);
 
 #endif /* TASKBAR_H */
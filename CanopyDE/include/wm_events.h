@@ -0,0 +1,52 @@
+#ifndef CANOPY_WM_EVENTS_H
+#define CANOPY_WM_EVENTS_H
+
+#include <glib.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * Consumer side of the client event ring written by CanopyWM. The memfd and
+ * the eventfd are inherited from the WM, their numbers in the environment.
+ * The layout must match CanopyWM/include/wm_events.h.
+ */
+#define CANOPY_EVENT_RING_ENV "CANOPY_EVENT_RING_FD"
+#define CANOPY_EVENT_NOTIFY_ENV "CANOPY_EVENT_NOTIFY_FD"
+#define WM_EVENTS_MAGIC 0x31455743u /* "CWE1" */
+#define WM_EVENTS_VERSION 1
+#define WM_EVENTS_SLOTS 512
+#define WM_EVENTS_TITLE_LEN 112
+
+enum {
+    WM_EVENT_CLIENT_ADD = 1,
+    WM_EVENT_CLIENT_REMOVE,
+    WM_EVENT_CLIENT_TITLE,
+    WM_EVENT_CLIENT_FOCUS,
+    WM_EVENT_CLIENT_URGENT,
+    WM_EVENT_RESET,
+    WM_EVENT_CLIENT_NOT_RESPONDING,
+};
+
+typedef struct {
+    uint32_t type;
+    uint32_t window;
+    uint32_t value;
+    uint32_t title_len;
+    char title[WM_EVENTS_TITLE_LEN];
+} WmEventRecord;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    _Alignas(64) _Atomic uint64_t head;
+    _Alignas(64) _Atomic uint64_t tail;
+    _Alignas(64) WmEventRecord records[WM_EVENTS_SLOTS];
+} WmEventRing;
+
+/* Attach the ring to the default main context; FALSE outside a CanopyWM session. */
+gboolean wm_events_init(void);
+void wm_events_cleanup(void);
+
+#endif
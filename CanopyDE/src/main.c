@@ -4,22 +4,27 @@
                     #include "desktop.h"
                     #include "settings.h"
                     #include "systray.h"
+                    #include "trace.h"
+                    #include "wm_events.h"
 
                     static void cleanup(void) {
+                        wm_events_cleanup();
                         panel_cleanup();
                         systray_cleanup();
                         settings_save();
                     }
 
                     int main(int argc, char *argv[]) {
-                        gtk_init(&argc, &argv);
+                        trace_init("CanopyDE", 0);
+                        TRACE_PHASE("gtk_init", gtk_init(&argc, &argv));
                         
                         // Initialize components
-                        settings_init();
-                        desktop_init();
+                        TRACE_PHASE("settings_init", settings_init());
+                        TRACE_PHASE("desktop_init", desktop_init());
 
-                        panel_init();
-                        systray_init();
+                        TRACE_PHASE("panel_init", panel_init());
+                        TRACE_PHASE("systray_init", systray_init());
+                        wm_events_init();
 
                         // Set default wallpaper if available
                         char *wallpaper = g_build_filename(CANOPY_DATADIR, "backgrounds",
@@ -0,0 +1,120 @@
+#include "notification_history.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static struct {
+    const NotificationHistoryHeader *header;
+    const NotificationHistoryRecord *slots;
+    uint32_t slot_count;    /* Validated against the mapping size at open */
+    size_t size;
+} history;
+
+static gboolean header_valid(const NotificationHistoryHeader *header) {
+    return header->magic == NOTIFICATION_HISTORY_MAGIC &&
+           header->version == NOTIFICATION_HISTORY_VERSION &&
+           header->slot_size == sizeof(NotificationHistoryRecord);
+}
+
+gboolean notification_history_open(void) {
+    if (history.header)
+        return TRUE;
+
+    const char *state = g_getenv("XDG_STATE_HOME");
+    char *path = (state && state[0] == '/')
+        ? g_build_filename(state, "canopy", NOTIFICATION_HISTORY_FILE, NULL)
+        : g_build_filename(g_get_home_dir(), ".local", "state", "canopy",
+                           NOTIFICATION_HISTORY_FILE, NULL);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    g_free(path);
+    if (fd < 0)
+        return FALSE;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(NotificationHistoryHeader)) {
+        close(fd);
+        return FALSE;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return FALSE;
+
+    const NotificationHistoryHeader *header = map;
+    if (!header_valid(header) || header->slot_count == 0 ||
+        sizeof(*header) + (size_t)header->slot_count * header->slot_size > (size_t)st.st_size) {
+        g_warning("Notification history has an unknown layout, ignoring it");
+        munmap(map, st.st_size);
+        return FALSE;
+    }
+
+    history.header = header;
+    history.slots = (const NotificationHistoryRecord *)(header + 1);
+    history.slot_count = header->slot_count;
+    history.size = st.st_size;
+    return TRUE;
+}
+
+void notification_history_close(void) {
+    if (history.header) {
+        munmap((void *)history.header, history.size);
+        history.header = NULL;
+        history.slots = NULL;
+    }
+}
+
+/* Copy record n out of the ring. Fails if the slot has been recycled or is
+   being rewritten by the WM while we read it. */
+static gboolean read_record(uint64_t n, NotificationHistoryRecord *out) {
+    const NotificationHistoryRecord *slot = &history.slots[(n - 1) % history.slot_count];
+
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != n)
+        return FALSE;
+
+    memcpy(out, slot, sizeof(*out));
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != n)
+        return FALSE;
+
+    out->app_name[sizeof(out->app_name) - 1] = '\0';
+    out->summary[sizeof(out->summary) - 1] = '\0';
+    out->body[sizeof(out->body) - 1] = '\0';
+    return TRUE;
+}
+
+/* Newest first; app_name NULL matches every record */
+static guint collect(const char *app_name, NotificationHistoryRecord *out, guint max) {
+    if (!history.header && !notification_history_open())
+        return 0;
+
+    /* The WM resets the header in place when the layout changes; drop the
+       mapping and pick up the new layout on the next call. */
+    if (!header_valid(history.header) || history.header->slot_count != history.slot_count) {
+        notification_history_close();
+        return 0;
+    }
+
+    uint64_t head = atomic_load_explicit(&history.header->head, memory_order_acquire);
+    uint64_t oldest = head > history.slot_count ? head - history.slot_count : 0;
+    guint count = 0;
+
+    for (uint64_t n = head; n > oldest && count < max; n--) {
+        if (read_record(n, &out[count]) &&
+            (!app_name || strcmp(out[count].app_name, app_name) == 0))
+            count++;
+    }
+    return count;
+}
+
+guint notification_history_last(NotificationHistoryRecord *out, guint max) {
+    return collect(NULL, out, max);
+}
+
+guint notification_history_find_by_app(const char *app_name,
+                                       NotificationHistoryRecord *out, guint max) {
+    return collect(app_name, out, max);
+}
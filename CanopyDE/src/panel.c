@@ -6,10 +6,28 @@
     #include "widgets/menu_button.h"
     #include "taskbar.h"
     #include "systray.h"
+    #include "wm_interface.h"
+    #include "trace.h"
     #include <gtk/gtk.h>
+    #include <gdk/gdkx.h>
 
     #define PANEL_HEIGHT 30
     static GList *panels = NULL;
+    static gboolean registered_with_wm = FALSE;
+
+    /* The first panel frame is on screen: tell the WM it can drop its
+       loading screen. Runs once, for whichever panel paints first. */
+    static void panel_after_first_paint(GdkFrameClock *clock, gpointer data) {
+        g_signal_handlers_disconnect_by_func(clock, panel_after_first_paint, data);
+        if (registered_with_wm)
+            return;
+        registered_with_wm = TRUE;
+        trace_instant("first_panel_frame");
+
+        Display *display = gdk_x11_display_get_xdisplay(gdk_display_get_default());
+        if (check_wm_running(display))
+            register_with_wm(display);
+    }
 
     void panel_init(void) {
         GdkDisplay *display = gdk_display_get_default();
@@ -58,13 +76,13 @@
         gtk_container_add(GTK_CONTAINER(panel->window), panel->box);
         
         /* Initialize widgets */
-        panel->menu_button = menu_button_new();
-        panel->taskbar = taskbar_new();
-        panel->systray = systray_new();
-        panel->clock = clock_new();
-        panel->volume = volume_new();
-        panel->network = network_new();
-        panel->battery = battery_new();
+        TRACE_PHASE("menu_button_new", panel->menu_button = menu_button_new());
+        TRACE_PHASE("taskbar_new", panel->taskbar = taskbar_new());
+        TRACE_PHASE("systray_new", panel->systray = systray_new());
+        TRACE_PHASE("clock_new", panel->clock = clock_new());
+        TRACE_PHASE("volume_new", panel->volume = volume_new());
+        TRACE_PHASE("network_new", panel->network = network_new());
+        TRACE_PHASE("battery_new", panel->battery = battery_new());
         
         /* Set minimum sizes */
         gtk_widget_set_size_request(panel->menu_button, 32, -1);
@@ -88,7 +106,11 @@
         
         gtk_box_pack_end(GTK_BOX(panel->box), status_box, FALSE, FALSE, 2);
         
-        gtk_widget_show_all(panel->window);
+        TRACE_PHASE("panel_show", gtk_widget_show_all(panel->window));
+        if (!registered_with_wm) {
+            g_signal_connect(gtk_widget_get_frame_clock(panel->window), "after-paint",
+                             G_CALLBACK(panel_after_first_paint), NULL);
+        }
         panels = g_list_append(panels, panel);
     }
 
@@ -1,15 +1,16 @@
 #include "taskbar.h"
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
-#include <X11/Xutil.h>        // For XTextProperty and XGetWMName
 #include <stdlib.h>
 #include <string.h>
 #include <gtk/gtk.h>
 #include <gdk/gdkx.h>         // For gdk_x11_display_get_xdisplay()
 
-/* 
+/*
  * The structures TaskbarWindow and Taskbar are defined in taskbar.h.
- * We use those definitions here.
+ * Windows, titles, focus and urgency all arrive from CanopyWM through the
+ * event ring (see wm_events.c), so the taskbar makes no X requests of its
+ * own except when a button is clicked.
  */
 
 static Taskbar *taskbar = NULL;
@@ -55,6 +56,16 @@ static void update_button_state(TaskbarWindow *win) {
         gtk_style_context_add_class(context, "active");
     else
         gtk_style_context_remove_class(context, "active");
+    if (win->urgent && !win->active)
+        gtk_style_context_add_class(context, "urgent");
+    else
+        gtk_style_context_remove_class(context, "urgent");
+}
+
+static void free_taskbar_window(TaskbarWindow *win) {
+    gtk_widget_destroy(win->button);
+    g_free(win->title);
+    g_free(win);
 }
 
 /* Create a new taskbar widget */
@@ -76,7 +87,8 @@ GtkWidget *taskbar_new(void) {
     gtk_css_provider_load_from_data(provider,
         " .taskbar { padding: 2px; } \n"
         " .taskbar button { padding: 2px 6px; } \n"
-        " .active-task { background-color: rgba(255,255,255,0.1); } \n",
+        " .active-task { background-color: rgba(255,255,255,0.1); } \n"
+        " .taskbar button.urgent { background-color: rgba(208,135,112,0.6); } \n",
         -1, NULL);
     gtk_style_context_add_provider_for_screen(gdk_screen_get_default(),
         GTK_STYLE_PROVIDER(provider),
@@ -87,13 +99,14 @@ GtkWidget *taskbar_new(void) {
 }
 
 /* Add a window to the taskbar */
-void taskbar_add_window(Window window) {
+void taskbar_add_window(Window window, const char *title) {
     if (!taskbar || find_taskbar_window(window))
         return;
 
     TaskbarWindow *win = g_new0(TaskbarWindow, 1);
     win->window = window;
-    win->button = gtk_button_new_with_label("");
+    win->title = g_strdup(title ? title : "");
+    win->button = gtk_button_new_with_label(win->title);
     win->active = FALSE;
 
     g_signal_connect(win->button, "clicked", G_CALLBACK(on_button_clicked), win);
@@ -102,40 +115,51 @@ void taskbar_add_window(Window window) {
     gtk_box_pack_start(GTK_BOX(taskbar->box), win->button, TRUE, TRUE, 0);
 
     taskbar->windows = g_list_append(taskbar->windows, win);
-    taskbar_update_window_title(window);
+    if (window == taskbar->active_window) {
+        win->active = TRUE;
+        update_button_state(win);
+    }
     gtk_widget_show_all(win->button);
 }
 
 /* Remove a window from the taskbar */
 void taskbar_remove_window(Window window) {
+    if (!taskbar)
+        return;
     TaskbarWindow *win = find_taskbar_window(window);
     if (win) {
-        gtk_widget_destroy(win->button);
-        g_free(win->title);
         taskbar->windows = g_list_remove(taskbar->windows, win);
-        g_free(win);
+        free_taskbar_window(win);
     }
 }
 
 /* Update the title of a window in the taskbar */
-void taskbar_update_window_title(Window window) {
+void taskbar_set_window_title(Window window, const char *title) {
+    if (!taskbar)
+        return;
     TaskbarWindow *win = find_taskbar_window(window);
-    if (!win)
+    if (!win || g_strcmp0(win->title, title) == 0)
         return;
 
-    Display *display = gdk_x11_display_get_xdisplay(gdk_display_get_default());
-    XTextProperty text_prop;
-    if (XGetWMName(display, window, &text_prop)) {
-        g_free(win->title);
-        win->title = g_strdup((char *)text_prop.value);
-        gtk_button_set_label(GTK_BUTTON(win->button), win->title);
-        XFree(text_prop.value);
+    g_free(win->title);
+    win->title = g_strdup(title);
+    gtk_button_set_label(GTK_BUTTON(win->button), win->title);
+}
+
+/* Highlight a window that asked for attention */
+void taskbar_set_window_urgent(Window window, gboolean urgent) {
+    if (!taskbar)
+        return;
+    TaskbarWindow *win = find_taskbar_window(window);
+    if (win && win->urgent != urgent) {
+        win->urgent = urgent;
+        update_button_state(win);
     }
 }
 
 /* Set the active window in the taskbar */
 void taskbar_set_active_window(Window window) {
-    if (taskbar->active_window == window)
+    if (!taskbar || taskbar->active_window == window)
         return;
 
     if (taskbar->active_window != None) {
@@ -156,16 +180,13 @@ void taskbar_set_active_window(Window window) {
     }
 }
 
-/* Update the taskbar (e.g., refresh window titles) */
-void taskbar_update(GtkWidget *taskbar_widget) {
+/* Drop every window, e.g. before the WM resends its client list */
+void taskbar_clear(void) {
     if (!taskbar)
         return;
-
-    GList *l;
-    for (l = taskbar->windows; l; l = l->next) {
-        TaskbarWindow *win = l->data;
-        taskbar_update_window_title(win->window);
-    }
+    g_list_free_full(taskbar->windows, (GDestroyNotify)free_taskbar_window);
+    taskbar->windows = NULL;
+    taskbar->active_window = None;
 }
 
 /* Clean up taskbar resources */
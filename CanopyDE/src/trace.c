@@ -0,0 +1,93 @@
+// src/trace.c
+#include "trace.h"
+#include <glib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static int trace_fd = -1;
+
+static uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Each event goes out in one write() on an O_APPEND descriptor, so events
+ * from both processes interleave whole. The array is left unterminated,
+ * which the trace viewers accept.
+ */
+static void trace_write(const char *buf, int len) {
+    if (len <= 0 || write(trace_fd, buf, len) != len) {
+        g_warning("Cannot write trace event, tracing disabled.");
+        close(trace_fd);
+        trace_fd = -1;
+    }
+}
+
+void trace_init(const char *process_name, int truncate) {
+    const char *path = g_getenv(CANOPY_TRACE_ENV);
+    if (!path || !path[0] || trace_fd >= 0)
+        return;
+
+    int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (truncate ? O_TRUNC : 0);
+    trace_fd = open(path, flags, 0644);
+    if (trace_fd < 0) {
+        g_warning("Cannot open trace file %s: %s", path, strerror(errno));
+        return;
+    }
+
+    char buf[256];
+    struct stat st;
+    if (fstat(trace_fd, &st) == 0 && st.st_size == 0)
+        trace_write("[\n", 2);
+    if (trace_fd >= 0) {
+        trace_write(buf, snprintf(buf, sizeof(buf),
+            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"name\":\"%s\"}},\n",
+            (int)getpid(), (int)getpid(), process_name));
+    }
+    g_message("Writing startup trace to %s", path);
+}
+
+void trace_close(void) {
+    if (trace_fd >= 0) {
+        close(trace_fd);
+        trace_fd = -1;
+    }
+}
+
+uint64_t trace_begin(void) {
+    return trace_fd >= 0 ? trace_now() : 0;
+}
+
+// Names are phase and function identifiers and are written unescaped
+void trace_end(const char *name, uint64_t start) {
+    if (trace_fd < 0 || start == 0)
+        return;
+
+    char buf[256];
+    trace_write(buf, snprintf(buf, sizeof(buf),
+        "{\"name\":\"%s\",\"cat\":\"startup\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,"
+        "\"pid\":%d,\"tid\":%d},\n",
+        name, (unsigned long long)start, (unsigned long long)(trace_now() - start),
+        (int)getpid(), (int)syscall(SYS_gettid)));
+}
+
+void trace_instant(const char *name) {
+    if (trace_fd < 0)
+        return;
+
+    char buf[256];
+    trace_write(buf, snprintf(buf, sizeof(buf),
+        "{\"name\":\"%s\",\"cat\":\"startup\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%llu,"
+        "\"pid\":%d,\"tid\":%d},\n",
+        name, (unsigned long long)trace_now(), (int)getpid(), (int)syscall(SYS_gettid)));
+}
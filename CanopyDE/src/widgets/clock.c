@@ -1,5 +1,6 @@
 // src/widgets/clock.c
 #include "widgets/clock.h"
+#include "notification_history.h"
 #include <time.h>
 #include <gtk/gtk.h>
 #include <glib.h>
@@ -18,10 +19,38 @@ static gboolean update_clock(gpointer data) {
     return G_SOURCE_CONTINUE;
 }
 
+/* Hovering the clock lists the newest notifications, read straight from
+   the history ring the WM maps. */
+#define CLOCK_HISTORY_ENTRIES 5
+
+static gboolean on_clock_query_tooltip(GtkWidget *widget, gint x, gint y,
+                                       gboolean keyboard_mode, GtkTooltip *tooltip,
+                                       gpointer data) {
+    (void)widget; (void)x; (void)y; (void)keyboard_mode; (void)data;
+    static NotificationHistoryRecord records[CLOCK_HISTORY_ENTRIES];
+    guint count = notification_history_last(records, CLOCK_HISTORY_ENTRIES);
+    if (count == 0)
+        return FALSE;
+
+    GString *text = g_string_new(NULL);
+    for (guint i = 0; i < count; i++) {
+        time_t t = (time_t)records[i].timestamp;
+        char when[16];
+        strftime(when, sizeof(when), "%H:%M", localtime(&t));
+        g_string_append_printf(text, "%s%s  %s: %s", i ? "\n" : "", when,
+                               records[i].app_name, records[i].summary);
+    }
+    gtk_tooltip_set_text(tooltip, text->str);
+    g_string_free(text, TRUE);
+    return TRUE;
+}
+
 GtkWidget *clock_new(void) {
     GtkWidget *label = gtk_label_new(NULL);
     update_clock(label);
     g_timeout_add_seconds(1, update_clock, label);
+    gtk_widget_set_has_tooltip(label, TRUE);
+    g_signal_connect(label, "query-tooltip", G_CALLBACK(on_clock_query_tooltip), NULL);
     return label;
 }
 
@@ -0,0 +1,154 @@
+#include "wm_events.h"
+#include "taskbar.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+    GSource source;
+    gpointer fd_tag;
+    WmEventRing *ring;
+    int ring_fd;
+    int notify_fd;
+} WmEventSource;
+
+static WmEventSource *event_source = NULL;
+
+static gboolean ring_pending(WmEventSource *src) {
+    uint64_t head = atomic_load_explicit(&src->ring->head, memory_order_acquire);
+    uint64_t tail = atomic_load_explicit(&src->ring->tail, memory_order_relaxed);
+    return head != tail;
+}
+
+static void apply_event(const WmEventRecord *r) {
+    char title[WM_EVENTS_TITLE_LEN + 1];
+    guint len = MIN(r->title_len, WM_EVENTS_TITLE_LEN);
+    memcpy(title, r->title, len);
+    title[len] = '\0';
+
+    switch (r->type) {
+    case WM_EVENT_CLIENT_ADD:
+        taskbar_add_window(r->window, len ? title : NULL);
+        break;
+    case WM_EVENT_CLIENT_REMOVE:
+        taskbar_remove_window(r->window);
+        break;
+    case WM_EVENT_CLIENT_TITLE:
+        taskbar_set_window_title(r->window, title);
+        break;
+    case WM_EVENT_CLIENT_FOCUS:
+        taskbar_set_active_window(r->window);
+        break;
+    case WM_EVENT_CLIENT_URGENT:
+        taskbar_set_window_urgent(r->window, r->value != 0);
+        break;
+    case WM_EVENT_RESET:
+        taskbar_clear();
+        break;
+    default:
+        break;
+    }
+}
+
+/* Events are applied straight from the ring; the title is copied out first */
+static void drain(WmEventSource *src) {
+    uint64_t head = atomic_load_explicit(&src->ring->head, memory_order_acquire);
+    uint64_t tail = atomic_load_explicit(&src->ring->tail, memory_order_relaxed);
+
+    while (tail != head) {
+        apply_event(&src->ring->records[tail & (WM_EVENTS_SLOTS - 1)]);
+        tail++;
+    }
+    atomic_store_explicit(&src->ring->tail, tail, memory_order_release);
+}
+
+static gboolean wm_events_prepare(GSource *source, gint *timeout) {
+    *timeout = -1;
+    return ring_pending((WmEventSource *)source);
+}
+
+static gboolean wm_events_check(GSource *source) {
+    WmEventSource *src = (WmEventSource *)source;
+    return (g_source_query_unix_fd(source, src->fd_tag) & G_IO_IN) || ring_pending(src);
+}
+
+static gboolean wm_events_dispatch(GSource *source, GSourceFunc callback, gpointer data) {
+    (void)callback;
+    (void)data;
+    WmEventSource *src = (WmEventSource *)source;
+
+    uint64_t count;
+    while (read(src->notify_fd, &count, sizeof(count)) > 0)
+        ;
+    drain(src);
+    return G_SOURCE_CONTINUE;
+}
+
+static void wm_events_finalize(GSource *source) {
+    WmEventSource *src = (WmEventSource *)source;
+    munmap(src->ring, sizeof(WmEventRing));
+    close(src->ring_fd);
+    close(src->notify_fd);
+}
+
+static GSourceFuncs wm_events_funcs = {
+    wm_events_prepare,
+    wm_events_check,
+    wm_events_dispatch,
+    wm_events_finalize,
+    NULL,
+    NULL,
+};
+
+gboolean wm_events_init(void) {
+    const char *ring_env = g_getenv(CANOPY_EVENT_RING_ENV);
+    const char *notify_env = g_getenv(CANOPY_EVENT_NOTIFY_ENV);
+    if (event_source || !ring_env || !notify_env)
+        return FALSE;
+
+    int ring_fd = atoi(ring_env);
+    int notify_fd = atoi(notify_env);
+    struct stat st;
+    if (ring_fd <= 2 || notify_fd <= 2 || fstat(ring_fd, &st) < 0 ||
+        (size_t)st.st_size != sizeof(WmEventRing)) {
+        g_warning("Inherited WM event ring is not usable");
+        return FALSE;
+    }
+
+    WmEventRing *ring = mmap(NULL, sizeof(WmEventRing), PROT_READ | PROT_WRITE,
+                             MAP_SHARED, ring_fd, 0);
+    if (ring == MAP_FAILED)
+        return FALSE;
+    if (ring->magic != WM_EVENTS_MAGIC || ring->version != WM_EVENTS_VERSION ||
+        ring->slot_count != WM_EVENTS_SLOTS || ring->slot_size != sizeof(WmEventRecord)) {
+        g_warning("WM event ring has an unknown layout, ignoring it");
+        munmap(ring, sizeof(WmEventRing));
+        return FALSE;
+    }
+
+    // Keep the descriptors out of the applications launched from the panel
+    fcntl(ring_fd, F_SETFD, FD_CLOEXEC);
+    fcntl(notify_fd, F_SETFD, FD_CLOEXEC);
+    fcntl(notify_fd, F_SETFL, fcntl(notify_fd, F_GETFL) | O_NONBLOCK);
+
+    GSource *source = g_source_new(&wm_events_funcs, sizeof(WmEventSource));
+    event_source = (WmEventSource *)source;
+    event_source->ring = ring;
+    event_source->ring_fd = ring_fd;
+    event_source->notify_fd = notify_fd;
+    event_source->fd_tag = g_source_add_unix_fd(source, notify_fd, G_IO_IN);
+    g_source_set_name(source, "CanopyWM events");
+    g_source_attach(source, NULL);
+    return TRUE;
+}
+
+void wm_events_cleanup(void) {
+    if (event_source) {
+        g_source_destroy((GSource *)event_source);
+        g_source_unref((GSource *)event_source);
+        event_source = NULL;
+    }
+}
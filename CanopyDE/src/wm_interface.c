@@ -1,6 +1,7 @@
 #include "wm_interface.h"
 #include <X11/Xatom.h>
 #include <stdio.h>
+#include <string.h>
 
 Bool check_wm_running(Display *display) {
     Atom wm_ready = XInternAtom(display, CANOPY_WM_READY, False);
@@ -26,8 +27,10 @@ void register_with_wm(Display *display) {
     Atom de_ready = XInternAtom(display, CANOPY_DE_READY, False);
     Window root = DefaultRootWindow(display);
     
-    // Send registration message
+    // Send registration message; only the WM selects SubstructureRedirect
+    // on the root window, so it is the only recipient
     XEvent ev;
+    memset(&ev, 0, sizeof(ev));
     ev.type = ClientMessage;
     ev.xclient.window = root;
     ev.xclient.message_type = de_ready;
@@ -0,0 +1,169 @@
+// bench/ini_bench.c
+//
+// Compares the legacy line-copying ini_parse() plus strcmp-chain handler
+// against the zero-copy ini_parse_view() driving config.c's real
+// config_ini_handler(). Build with -DCANOPY_BUILD_BENCH=ON and run ./ini_bench.
+#include "config.h"
+#include "event_loop.h"
+#include "worker_pool.h"
+#include "ini.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *sample_lines[] = {
+    "border_width = 3",
+    "border_color = 0x333333",
+    "focus_border_color = 0x007acc",
+    "titlebar_height = 26",
+    "title_text_color = 0xeeeeee",
+    "font_size = 11",
+};
+
+static const char *sample_tail =
+    "[layout]\n"
+    "master_size = 640\n"
+    "split_ratio = 0.55\n"
+    "snap_distance = 12\n"
+    "[appearance]\n"
+    "; comment lines are skipped by both parsers\n"
+    "wallpaper_path = /usr/share/backgrounds/canopy.png\n"
+    "wallpaper_mode = center\n"
+    "background_color = 0x202020\n"
+    "[system]\n"
+    "volume_step = 5\n"
+    "brightness_step = 10\n";
+
+static unsigned long sink;
+
+/* -- Legacy path: NUL-terminated strings and a strcmp chain -- */
+
+#define MATCH(s, n) (strcmp(section, s) == 0 && strcmp(name, n) == 0)
+
+static int legacy_handler(void *user, const char *section,
+                          const char *name, const char *value) {
+    Config *cfg = user;
+    unsigned int number = (unsigned int)strtoul(value, NULL, 0);
+
+    if (MATCH("window", "border_width")) {
+        cfg->window.border_width = number;
+    } else if (MATCH("window", "border_color")) {
+        cfg->window.border_color = number;
+    } else if (MATCH("window", "focus_color") || MATCH("window", "focus_border_color")) {
+        cfg->window.focus_border_color = number;
+    } else if (MATCH("window", "titlebar_height")) {
+        cfg->window.titlebar_height = number;
+    } else if (MATCH("window", "titlebar_color")) {
+        cfg->window.titlebar_color = number;
+    } else if (MATCH("window", "title_text_color")) {
+        cfg->window.title_text_color = number;
+    } else if (MATCH("window", "button_color")) {
+        cfg->window.button_color = number;
+    } else if (MATCH("window", "button_text_color")) {
+        cfg->window.button_text_color = number;
+    } else if (MATCH("window", "font_size")) {
+        cfg->window.font_size = number;
+    } else if (MATCH("window", "snap_distance") || MATCH("layout", "snap_distance")) {
+        cfg->layout.snap_distance = number;
+    } else if (MATCH("layout", "master_size")) {
+        cfg->layout.master_size = number;
+    } else if (MATCH("layout", "master_count")) {
+        cfg->layout.master_count = number;
+    } else if (MATCH("layout", "split_ratio")) {
+        cfg->layout.split_ratio = strtof(value, NULL);
+    } else if (MATCH("appearance", "wallpaper_path")) {
+        sink += strlen(value);
+    } else if (MATCH("appearance", "wallpaper_mode")) {
+        cfg->appearance.wallpaper_mode = strcmp(value, "center") == 0 ? WALLPAPER_CENTER
+                                                                      : WALLPAPER_STRETCH;
+    } else if (MATCH("appearance", "background_color")) {
+        cfg->appearance.background_color = number;
+    } else if (MATCH("system", "volume_step")) {
+        cfg->system.volume_step = number;
+    } else if (MATCH("system", "brightness_step")) {
+        cfg->system.brightness_step = number;
+    }
+    return 1;
+}
+#undef MATCH
+
+/* -- Current path: config.c's own handler over string views -- */
+
+/* config.c's hot-reload hooks; the bench never calls config_init() */
+void wm_apply_config(unsigned int changed) { (void)changed; }
+bool event_loop_add_fd(int fd, EventLoopCallback callback, void *data) {
+    (void)fd; (void)callback; (void)data;
+    return false;
+}
+void event_loop_remove_fd(int fd) { (void)fd; }
+bool worker_pool_submit(const char *name, WorkerFunc func, WorkerDoneFunc done, void *data) {
+    (void)name; (void)func; (void)done; (void)data;
+    return false;
+}
+
+/* Write a config with the given number of [window] blocks; returns line count */
+static int write_config(const char *path, int blocks) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    int lines = 0;
+    for (int b = 0; b < blocks; b++) {
+        fprintf(f, "[window]\n");
+        lines++;
+        for (size_t i = 0; i < sizeof(sample_lines) / sizeof(sample_lines[0]); i++) {
+            fprintf(f, "%s\n", sample_lines[i]);
+            lines++;
+        }
+    }
+    fputs(sample_tail, f);
+    for (const char *p = sample_tail; *p; p++)
+        lines += *p == '\n';
+    fclose(f);
+    return lines;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run(const char *label, int blocks, int iterations) {
+    char path[] = "/tmp/canopy-ini-bench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        exit(1);
+    }
+    close(fd);
+
+    int lines = write_config(path, blocks);
+    Config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+
+    double start = now_ns();
+    for (int i = 0; i < iterations; i++)
+        ini_parse(path, legacy_handler, &cfg);
+    double legacy = (now_ns() - start) / iterations;
+
+    start = now_ns();
+    for (int i = 0; i < iterations; i++)
+        ini_parse_view(path, config_ini_handler, &cfg);
+    double view = (now_ns() - start) / iterations;
+    sink += cfg.window.border_width;
+    free(cfg.appearance.wallpaper_path);
+
+    printf("%-6s %6d lines  legacy %9.0f ns (%6.1f ns/line)  view %9.0f ns (%6.1f ns/line)  %.2fx\n",
+           label, lines, legacy, legacy / lines, view, view / lines, legacy / view);
+    unlink(path);
+}
+
+int main(void) {
+    run("small", 1, 20000);
+    run("large", 2000, 50);
+    // Print the sink so the handlers' stores cannot be optimized away
+    fprintf(stderr, "sink %lu\n", sink);
+    return 0;
+}
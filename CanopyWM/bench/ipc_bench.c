@@ -0,0 +1,192 @@
+// bench/ipc_bench.c
+//
+// Throughput of the CanopyWM control socket against a running WM. Sends
+// pipelined no-op commands (IPC_MSG_WORKSPACE, answered without touching
+// any window) and reports round trips per second; with -s it also keeps a
+// subscriber open and reports how many events and gaps it saw meanwhile.
+// With -w WINDOW it moves that client back and forth instead and reports
+// the X requests and round trips the WM made per command.
+// Build with -DCANOPY_BUILD_BENCH=ON and run
+// ./ipc_bench [-n COUNT] [-d DEPTH] [-s] [-w WINDOW].
+#include "ipc_protocol.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+static int connect_wm(void) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    ipc_socket_path(addr.sun_path, sizeof(addr.sun_path));
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "ipc_bench: cannot connect to %s: %s\n", addr.sun_path, strerror(errno));
+        exit(1);
+    }
+    return fd;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Consume whole messages from buf, counting replies, events and gaps */
+static size_t parse(const char *buf, size_t len, long *replies, long *events, long *gaps) {
+    size_t pos = 0;
+    while (len - pos >= sizeof(IpcHeader)) {
+        IpcHeader header;
+        memcpy(&header, buf + pos, sizeof(header));
+        if (len - pos < sizeof(header) + header.length)
+            break;
+        const char *payload = buf + pos + sizeof(header);
+        if (header.type == IPC_MSG_REPLY) {
+            (*replies)++;
+        } else if (header.type == IPC_MSG_GAP) {
+            (*gaps)++;
+        } else if (header.type == IPC_MSG_EVENTS) {
+            for (uint32_t off = 0; off + sizeof(IpcEvent) <= header.length; (*events)++) {
+                IpcEvent ev;
+                memcpy(&ev, payload + off, sizeof(ev));
+                off += sizeof(ev) + ev.title_len;
+            }
+        }
+        pos += sizeof(header) + header.length;
+    }
+    return pos;
+}
+
+/* The WM's request counters for IPC commands; call with no commands in flight */
+static IpcXStats query_xstats(int fd) {
+    IpcXStats result = { 0 };
+    IpcHeader cmd = { .type = IPC_MSG_XSTATS };
+    if (write(fd, &cmd, sizeof(cmd)) != sizeof(cmd)) return result;
+
+    static char buf[16 * 1024];
+    for (;;) {
+        IpcHeader header;
+        if (read(fd, &header, sizeof(header)) != sizeof(header) || header.length > sizeof(buf))
+            break;
+        size_t got = 0;
+        while (got < header.length) {
+            ssize_t n = read(fd, buf + got, header.length - got);
+            if (n <= 0) return result;
+            got += n;
+        }
+        if (header.type == IPC_MSG_REPLY)
+            break;
+        if (header.type != IPC_MSG_XSTATS_DATA)
+            continue;
+        for (uint32_t pos = 0; pos + sizeof(IpcXStats) <= header.length; pos += sizeof(IpcXStats)) {
+            IpcXStats s;
+            memcpy(&s, buf + pos, sizeof(s));
+            s.name[sizeof(s.name) - 1] = '\0';
+            if (strcmp(s.name, "ipc") == 0)
+                result = s;
+        }
+    }
+    return result;
+}
+
+int main(int argc, char **argv) {
+    long count = 100000;
+    int depth = 64;
+    bool subscribe = false;
+    uint32_t window = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:sw:")) != -1) {
+        switch (opt) {
+        case 'n': count = atol(optarg); break;
+        case 'd': depth = atoi(optarg); break;
+        case 's': subscribe = true; break;
+        case 'w': window = (uint32_t)strtoul(optarg, NULL, 0); break;
+        default:
+            fprintf(stderr, "usage: ipc_bench [-n COUNT] [-d DEPTH] [-s] [-w WINDOW]\n");
+            return 2;
+        }
+    }
+    if (count <= 0 || depth <= 0) return 2;
+
+    int fd = connect_wm();
+    long sub_replies = 0, events = 0, gaps = 0;
+    int sub_fd = -1;
+    if (subscribe) {
+        sub_fd = connect_wm();
+        struct { IpcHeader header; uint32_t mask; } msg = {
+            { .length = sizeof(uint32_t), .type = IPC_MSG_SUBSCRIBE }, IPC_EVENT_ALL
+        };
+        if (write(sub_fd, &msg, sizeof(msg)) != sizeof(msg)) return 1;
+    }
+
+    struct { IpcHeader header; uint32_t index; } cmd = {
+        { .length = sizeof(uint32_t), .type = IPC_MSG_WORKSPACE }, 0
+    };
+    struct { IpcHeader header; IpcMoveArg arg; } move = {
+        { .length = sizeof(IpcMoveArg), .type = IPC_MSG_MOVE }, { window, 100, 100 }
+    };
+    IpcXStats before = window ? query_xstats(fd) : (IpcXStats){ 0 };
+    static char in[64 * 1024], sub_in[64 * 1024];
+    size_t in_len = 0, sub_len = 0;
+    long sent = 0, replies = 0, unused = 0;
+
+    double start = now();
+    while (replies < count) {
+        while (sent < count && sent - replies < depth) {
+            bool ok;
+            if (window) {
+                move.arg.x = 100 + (sent & 1);
+                ok = write(fd, &move, sizeof(move)) == sizeof(move);
+            } else {
+                ok = write(fd, &cmd, sizeof(cmd)) == sizeof(cmd);
+            }
+            if (!ok) {
+                fprintf(stderr, "ipc_bench: write failed: %s\n", strerror(errno));
+                return 1;
+            }
+            sent++;
+        }
+
+        ssize_t n = read(fd, in + in_len, sizeof(in) - in_len);
+        if (n <= 0) {
+            fprintf(stderr, "ipc_bench: connection closed after %ld replies\n", replies);
+            return 1;
+        }
+        in_len += n;
+        size_t used = parse(in, in_len, &replies, &unused, &unused);
+        memmove(in, in + used, in_len - used);
+        in_len -= used;
+
+        if (sub_fd >= 0) {
+            n = recv(sub_fd, sub_in + sub_len, sizeof(sub_in) - sub_len, MSG_DONTWAIT);
+            if (n > 0) {
+                sub_len += n;
+                used = parse(sub_in, sub_len, &sub_replies, &events, &gaps);
+                memmove(sub_in, sub_in + used, sub_len - used);
+                sub_len -= used;
+            }
+        }
+    }
+    double elapsed = now() - start;
+
+    printf("%ld commands, depth %d: %.3f s, %.0f commands/s, %.2f us/command\n",
+           count, depth, elapsed, count / elapsed, elapsed * 1e6 / count);
+    if (sub_fd >= 0)
+        printf("subscriber: %ld events, %ld gaps\n", events, gaps);
+    if (window) {
+        IpcXStats after = query_xstats(fd);
+        printf("X: %.2f requests/command, %.3f round trips/command\n",
+               (double)(after.requests - before.requests) / count,
+               (double)(after.round_trips - before.round_trips) / count);
+    }
+
+    close(fd);
+    if (sub_fd >= 0) close(sub_fd);
+    return 0;
+}
@@ -11,6 +11,8 @@ typedef struct {
 } AudioManager;
 
 void audio_manager_init(void);
+AudioManager *audio_manager_load(void);
+void audio_manager_publish(AudioManager *loaded);
 void audio_manager_cleanup(void);
 void audio_set_volume(int volume);
 void audio_toggle_mute(void);
@@ -2,8 +2,61 @@
 #ifndef CLIENT_H
 #define CLIENT_H
 
+#include "props.h"
 #include <X11/Xlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+#define CLIENT_TITLE_INTERVAL_MS 16.0   // At most one title update per client per frame
+#define CLIENT_MAX 65535                // Slots are 16 bits of a handle
+#define CLIENT_TITLE_INLINE 24          // Titles shorter than this are stored in the Client
+
+/*
+ * Clients live in a slab and never move while managed. Code that keeps a
+ * client across events stores a ClientHandle, which stops resolving once
+ * the slot is freed: its generation is bumped on every free.
+ */
+typedef uint32_t ClientHandle;          // Generation << 16 | slot; 0 is never valid
+#define CLIENT_HANDLE_NONE 0
+
+enum {
+    CLIENT_FLAG_LIVE = 1 << 0,          // Slot holds a managed client
+    CLIENT_FLAG_FULLSCREEN = 1 << 1,
+    CLIENT_FLAG_FLOATING = 1 << 2,
+};
+
+/* Hot per-client fields, one array per field indexed by slot, scanned linearly */
+typedef struct {
+    Window *window;
+    Window *frame;
+    int *x;
+    int *y;
+    unsigned int *width;
+    unsigned int *height;
+    uint8_t *flags;                     // CLIENT_FLAG_*
+    uint16_t *generation;
+    uint32_t used;                      // Slots handed out at least once
+    uint32_t capacity;
+} ClientTable;
+
+extern ClientTable client_table;
+
+#define CLIENT_X(c) (client_table.x[(c)->slot])
+#define CLIENT_Y(c) (client_table.y[(c)->slot])
+#define CLIENT_WIDTH(c) (client_table.width[(c)->slot])
+#define CLIENT_HEIGHT(c) (client_table.height[(c)->slot])
+#define CLIENT_FLAGS(c) (client_table.flags[(c)->slot])
+
+typedef struct {
+    uint16_t length;
+    uint8_t size_class;                 // CLIENT_TITLE_NONE, CLIENT_TITLE_INLINE_CLASS or arena class + 2
+    union {
+        char inline_str[CLIENT_TITLE_INLINE];
+        char *arena_str;
+    };
+} ClientTitle;
+
+enum { CLIENT_TITLE_NONE, CLIENT_TITLE_INLINE_CLASS };
 
 typedef struct Decoration {
     Window handle;
@@ -13,28 +66,104 @@ typedef struct Decoration {
     unsigned int button_size;
 } Decoration;
 
+/* Cold per-client state; geometry and flags are in client_table */
 typedef struct Client {
-    Window window;
-    Window frame;
-    char *title;
-    int x, y;
-    unsigned int width, height;
-    bool is_fullscreen;
-    bool is_floating;
+    uint32_t slot;
+    Window window;                           // Same as client_table.window[slot]
+    Window frame;                            // Same as client_table.frame[slot]
+    ClientTitle title;
+    bool is_urgent;                          // XUrgencyHint set in WM_HINTS
     bool needs_redraw;
-    struct Client *next;
+    ClientProps props;                       // Cached window properties
+    bool title_pending;                      // Title changed, update deferred to a later frame
+    double title_time;                       // Monotonic ms of the last title update
+    unsigned long title_changes;             // Title PropertyNotify events received
+    unsigned long titles_suppressed;         // Changes folded into a pending update
+    double event_window_start;               // Monotonic ms the current budget window began
+    unsigned int window_events;              // Non-input events received in that window
+    bool throttled;                          // Over budget: events deferred, no PropertyNotify
+    double throttled_until;                  // Monotonic ms throttling may end
+    unsigned long events_deferred;
+    long ping_token;                         // Outstanding _NET_WM_PING, 0 if none
+    double ping_sent;                        // Monotonic ms of the latest ping
+    bool not_responding;                     // Left a ping unanswered past PING_TIMEOUT_MS
+    int saved_x, saved_y;                    // Geometry to restore after fullscreen
+    unsigned int saved_width, saved_height;
     Decoration decor;
 } Client;
 
+typedef struct {
+    Client *focused;
+    int num_clients;
+} ClientManager;
+
+// Global client manager instance
+extern ClientManager client_manager;
+
+static inline bool client_is_fullscreen(const Client *c) {
+    return CLIENT_FLAGS(c) & CLIENT_FLAG_FULLSCREEN;
+}
+
+static inline bool client_is_floating(const Client *c) {
+    return CLIENT_FLAGS(c) & CLIENT_FLAG_FLOATING;
+}
+
+static inline void client_set_flag(Client *c, uint8_t flag, bool on) {
+    if (on)
+        CLIENT_FLAGS(c) |= flag;
+    else
+        CLIENT_FLAGS(c) &= ~flag;
+}
+
+// Slab (client_slab.c)
+Client *client_slot_alloc(Window window, Window frame);
+void client_slot_free(Client *client);
+ClientHandle client_handle(const Client *client);
+Client *client_from_handle(ClientHandle handle);
+Client *client_first(void);                  // Iterates in slot order
+Client *client_next(const Client *client);
+Client *client_slot_find(Window window);
+void client_slab_cleanup(void);
+
+// Titles, from a size-class arena unless short enough to be inline
+void client_title_set(ClientTitle *title, const char *str);
+void client_title_clear(ClientTitle *title);
+const char *client_title(const Client *client); // NULL if the client has no title
+
 // Client management API
 Client *client_create(Display *dpy, Window window, int x, int y,
                      unsigned int width, unsigned int height);
 void client_destroy(Display *dpy, Client *client);
 Client *client_from_window(Display *dpy, Window win);
 void client_set_title(Display *dpy, Client *client, const char *title);
-void client_focus(Display *dpy, Client *client);
-void client_resize(Display *dpy, Client *client, 
+void client_focus(Client *client);
+void client_resize(Display *dpy, Client *client,
                   unsigned int width, unsigned int height);
-void client_move(Display *dpy, Client *client, int x, int y);
+void client_move(Client *client, int x, int y);
+
+// Client manager API
+void client_manager_init(Display *dpy);
+void client_manager_cleanup(Display *dpy);
+Client *client_add(Window window);
+Client *client_adopt(Window window, Window frame);
+void client_remove(Window window);
+Client *client_find_by_window(Window window);
+void client_update_title(Client *client);
+void client_title_changed(Client *client);
+void client_flush_titles(void);
+void client_dump_stats(void);
+void client_update_urgency(Client *client);
+void client_set_throttled(Client *client, bool throttled);
+void client_close(Client *client);
+void client_draw_decorations(Client *client);
+void client_redraw_all(void);
+void client_reframe_all(void);
+
+// Keybinding actions
+void client_focus_next(void);
+void client_cycle_focus(void);
+void client_close_focused(void);
+void client_set_fullscreen(Client *c, bool fullscreen);
+void client_toggle_fullscreen_focused(void);
 
-#endif // CLIENT_H
\ No newline at end of file
+#endif // CLIENT_H
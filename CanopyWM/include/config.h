@@ -2,6 +2,7 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include "ini.h"
 #include <stdbool.h>
 
 // Configuration structures
@@ -39,20 +40,51 @@ typedef struct {
 typedef struct {
     unsigned int volume_step;
     unsigned int brightness_step;
+    unsigned int cpu_weight_focused;     // cpu.weight of the focused app, 0 for the default
+    unsigned int cpu_weight_background;  // cpu.weight of apps with no visible window
 } SystemConfig;
 
+#define CONFIG_MAX_KEYBINDS 64
+
+typedef struct {
+    char *mode;     // Mode the binding belongs to, NULL for the default mode
+    char *action;   // Action and its argument, e.g. "close" or "spawn xterm"
+    char *keys;     // Key sequence, e.g. "Alt+Shift+q" or "Super+w h"
+} KeybindConfig;
+
+typedef struct {
+    KeybindConfig binds[CONFIG_MAX_KEYBINDS];
+    int count;
+} KeybindsConfig;
+
 typedef struct {
     WindowConfig window;
     LayoutConfig layout;
     AppearanceConfig appearance;
     SystemConfig system;
+    KeybindsConfig keybinds;
 } Config;
 
+// Sections that differ between two configurations (see config_diff)
+#define CONFIG_CHANGED_DECORATION  (1u << 0)  // Frame colors and title font
+#define CONFIG_CHANGED_FRAME       (1u << 1)  // Border width and titlebar height
+#define CONFIG_CHANGED_APPEARANCE  (1u << 2)  // Wallpaper and background
+#define CONFIG_CHANGED_SYSTEM      (1u << 3)
+#define CONFIG_CHANGED_KEYBINDS    (1u << 4)
+#define CONFIG_CHANGED_ALL         0xffffffffu
+
 extern Config config;
 
 // Function declarations
 void config_init(void);
 void config_cleanup(void);
 bool config_load(const char *path);
+unsigned int config_reload(void);
+unsigned int config_diff(const Config *a, const Config *b);
+const char *config_get_path(void);
+
+// Store one "[section] name = value" into the Config passed as user; the
+// handler config_load() parses with, exposed for bench/ini_bench.c
+int config_ini_handler(void *user, IniStr section, IniStr name, IniStr value);
 
 #endif // CONFIG_H
\ No newline at end of file
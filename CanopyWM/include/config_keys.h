@@ -0,0 +1,41 @@
+#ifndef CANOPY_CONFIG_KEYS_H
+#define CANOPY_CONFIG_KEYS_H
+
+#include "ini.h"
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    CONFIG_KEY_UINT,
+    CONFIG_KEY_FLOAT,
+    CONFIG_KEY_STRING,
+    CONFIG_KEY_WALLPAPER_MODE
+} ConfigKeyType;
+
+typedef struct {
+    const char *section;
+    const char *name;
+    uint8_t section_len;
+    uint8_t name_len;
+    ConfigKeyType type;
+    size_t offset;          // Offset of the field inside Config
+} ConfigKey;
+
+/*
+ * FNV-1a over "section.name". The generator picks the seed so that every
+ * key in config_keys.def lands in its own slot of the table.
+ */
+static inline uint32_t config_key_hash(uint32_t seed, IniStr section, IniStr name) {
+    uint32_t h = seed;
+    for (size_t i = 0; i < section.len; i++)
+        h = (h ^ (unsigned char)section.ptr[i]) * 16777619u;
+    h = (h ^ '.') * 16777619u;
+    for (size_t i = 0; i < name.len; i++)
+        h = (h ^ (unsigned char)name.ptr[i]) * 16777619u;
+    return h;
+}
+
+// Resolve an option with one hash and one compare; NULL if unknown
+const ConfigKey *config_key_lookup(IniStr section, IniStr name);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef CANOPY_CPU_POLICY_H
+#define CANOPY_CPU_POLICY_H
+
+#include <systemd/sd-bus.h>
+
+/*
+ * CPU weight per application. Clients are mapped to their process through
+ * _NET_WM_PID, and only if WM_CLIENT_MACHINE names this host; the first
+ * time an application needs a weight other than the default it is moved
+ * into a transient scope of its own (app-canopy-<pid>.scope) and the
+ * scope's CPUWeight is set from then on. The application owning the
+ * focused window gets [system] cpu_weight_focused, one whose windows are
+ * all hidden gets cpu_weight_background, and every other one the default;
+ * 0 in the config means the default. Changes are debounced, so cycling
+ * focus quickly sends one batch of calls once it settles. All calls are
+ * asynchronous, and the scopes go back to the default when the WM exits.
+ */
+#define CPU_WEIGHT_DEFAULT 100             // cgroup v2 default cpu.weight
+#define CPU_POLICY_DEBOUNCE_MS 300.0       // Quiet time before changes are applied
+#define CPU_POLICY_MAX_DELAY_MS 2000.0     // Applied by then even if changes keep coming
+#define CPU_POLICY_MAX_APPS 128
+
+/*
+ * Connect to the user's service manager. Scopes for our own processes are
+ * created there; the system manager behind wm.bus would refuse them.
+ * Blocking; meant for a worker thread, see cpu_policy_publish().
+ */
+sd_bus *cpu_policy_connect(void);
+
+/* Start using a connection from cpu_policy_connect(); NULL leaves the policy off. */
+void cpu_policy_publish(sd_bus *bus);
+
+/* Reset the scopes to the default weight and disconnect. */
+void cpu_policy_cleanup(void);
+
+/* Focus, visibility, the client set or the weights changed. */
+void cpu_policy_changed(void);
+
+/* Apply settled changes; once per main loop iteration. */
+void cpu_policy_flush(void);
+
+void cpu_policy_dump_stats(void);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef CANOPY_DE_SUPERVISOR_H
+#define CANOPY_DE_SUPERVISOR_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+// Restart delay doubles with every consecutive crash, up to the cap
+#define DE_RESTART_DELAY_MS 500
+#define DE_RESTART_MAX_DELAY_MS 30000
+
+// Give up after this many crashes within the window (seconds); a DE that
+// stayed up for a whole window resets the backoff
+#define DE_CRASH_LOOP_LIMIT 5
+#define DE_CRASH_LOOP_WINDOW 60
+
+/* Called when the DE exits with status 0, i.e. the user logged out. */
+typedef void (*DeSessionEndFunc)(void);
+
+/*
+ * Spawn the DE and watch it through a pidfd in the event loop. A crash
+ * restarts it after a backoff; clients stay managed throughout.
+ */
+bool de_supervisor_start(const char *path, DeSessionEndFunc on_session_end);
+
+/* Supervise a DE started by the image before a restart; spawns one if pid <= 0. */
+bool de_supervisor_adopt(pid_t pid, const char *path, DeSessionEndFunc on_session_end);
+
+/* Terminate and reap the DE, cancelling any pending restart. */
+void de_supervisor_stop(void);
+
+/* The running DE reported its first frame. */
+void de_supervisor_handle_ready(void);
+
+pid_t de_supervisor_pid(void);
+
+#endif
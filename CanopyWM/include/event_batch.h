@@ -0,0 +1,33 @@
+#ifndef CANOPY_EVENT_BATCH_H
+#define CANOPY_EVENT_BATCH_H
+
+#include <X11/Xlib.h>
+
+/*
+ * Prioritized X event dispatch. The queued events are drained into a batch;
+ * input events (keys, buttons, motion) are handled first, in their original
+ * order, and the rest after them. Input never overtakes a keymap change, a
+ * focus or crossing event or a _NET_ACTIVE_WINDOW request, as those decide
+ * where it goes. Within a batch, a PropertyNotify for a
+ * (window, atom) pair that changes again later, a ConfigureRequest that a
+ * later one for the same window fully overrides and a MotionNotify followed
+ * by another on the same window are skipped.
+ *
+ * Non-input events are also charged to the client they are about. A client
+ * over its budget is throttled: its events go to a low-priority queue that
+ * is worked off a few per iteration, and PropertyNotify is deselected on its
+ * window until it has been quiet for CLIENT_THROTTLE_MS.
+ */
+#define EVENT_BATCH_MAX 256
+#define CLIENT_EVENT_BUDGET 200            // Non-input events per client per window
+#define CLIENT_EVENT_WINDOW_MS 100.0
+#define CLIENT_THROTTLE_MS 1000.0          // Quiet time before a throttled client is let go
+#define EVENT_DEFERRED_MAX 1024
+#define EVENT_DEFERRED_PER_ITERATION 32
+
+/* Handle everything queued, one batch at a time, then some deferred events; does not block. */
+void event_batch_dispatch(Display *dpy);
+
+void event_batch_dump_stats(void);
+
+#endif
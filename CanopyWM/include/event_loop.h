@@ -0,0 +1,29 @@
+#ifndef CANOPY_EVENT_LOOP_H
+#define CANOPY_EVENT_LOOP_H
+
+#include <stdbool.h>
+
+#define EVENT_LOOP_MAX_FDS 64
+#define EVENT_LOOP_BUSY_BUDGET_USEC 1000   // Longest the main thread should go without polling
+
+/* Called from the main loop when a watched descriptor becomes readable. */
+typedef void (*EventLoopCallback)(int fd, void *data);
+
+bool event_loop_add_fd(int fd, EventLoopCallback callback, void *data);
+void event_loop_remove_fd(int fd);
+
+/*
+ * Sleep until the X connection or a watched descriptor is readable, or the
+ * timeout expires, then run the callbacks of the ready descriptors. X events
+ * are left for the caller to drain.
+ */
+void event_loop_wait(int xfd, long timeout_usec);
+
+/*
+ * Log how long the main thread stayed away from select() per iteration and
+ * per callback. Iterations over EVENT_LOOP_BUSY_BUDGET_USEC are counted and
+ * recorded as "main_loop_blocked" in the startup trace when it is enabled.
+ */
+void event_loop_dump_stats(void);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef CANOPY_EWMH_H
+#define CANOPY_EWMH_H
+
+#include <X11/Xlib.h>
+
+/*
+ * EWMH root window properties: _NET_SUPPORTED, _NET_SUPPORTING_WM_CHECK,
+ * _NET_CLIENT_LIST, _NET_CLIENT_LIST_STACKING and _NET_ACTIVE_WINDOW.
+ * Of the per-window state only _NET_WM_STATE_FULLSCREEN is supported, see
+ * client_set_fullscreen().
+ * New clients are appended to the lists in place; removals, restacking and
+ * focus changes only mark a property dirty, and ewmh_flush() rewrites each
+ * dirty property once per main loop iteration.
+ */
+
+void ewmh_init(void);
+void ewmh_cleanup(void);
+
+void ewmh_client_added(Window window);
+void ewmh_client_removed(Window window);
+void ewmh_client_raised(Window window);
+void ewmh_set_active(Window window);
+
+/* Write the properties changed since the last call; once per main loop iteration. */
+void ewmh_flush(void);
+
+#endif
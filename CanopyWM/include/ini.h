@@ -1,6 +1,9 @@
 #ifndef INI_H
 #define INI_H
 
+#include <stddef.h>
+#include <string.h>
+
 /* Simple INI parser */
 typedef int (*ini_handler)(void* user, const char* section,
                           const char* name, const char* value);
@@ -8,4 +11,26 @@ typedef int (*ini_handler)(void* user, const char* section,
 int ini_parse(const char* filename, ini_handler handler, void* user);
 int ini_parse_string(const char* string, ini_handler handler, void* user);
 
+/* A view into the parsed buffer; not NUL-terminated */
+typedef struct {
+    const char* ptr;
+    size_t len;
+} IniStr;
+
+typedef int (*ini_view_handler)(void* user, IniStr section,
+                               IniStr name, IniStr value);
+
+/* Zero-copy parser: maps the file (small files are read onto the stack)
+   and hands out views into that buffer, which are only valid during the
+   callback. Lines may be of any length.
+   Returns 1 on success, 0 if the handler aborted, -1 if the file can't be
+   read. */
+int ini_parse_view(const char* filename, ini_view_handler handler, void* user);
+int ini_parse_buffer(const char* data, size_t len, ini_view_handler handler, void* user);
+
+static inline int ini_str_eq(IniStr s, const char* literal) {
+    size_t len = strlen(literal);
+    return s.len == len && memcmp(s.ptr, literal, len) == 0;
+}
+
 #endif
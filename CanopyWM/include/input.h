@@ -1,24 +1,78 @@
 #ifndef CANOPY_INPUT_H
 #define CANOPY_INPUT_H
 
+#include "client.h"
 #include <X11/Xlib.h>
 #include <X11/keysym.h>
 #include <stdbool.h>
 
+#define INPUT_MAX_CHORD 4          // Keys in one sequence, e.g. "Super+w h"
+#define INPUT_MAX_MODES 16
+#define INPUT_DEFAULT_MODE 0
+
+// Action argument, parsed once when the bindings are compiled
 typedef struct {
-    KeySym key;
-    unsigned int modifiers;
-    void (*callback)(void);
+    char *str;                     // Rest of the action string, e.g. the spawn command
+    int x, y;                      // Numeric arguments, e.g. "move -20 0"
+    int mode;                      // Target of "mode <name>"
+} InputArg;
+
+typedef struct {
+    const char *name;
+    void (*callback)(const InputArg *arg);
+} InputAction;
+
+// A binding from the config, compiled into the trie on every keymap rebuild
+typedef struct {
+    int mode;
+    KeySym keys[INPUT_MAX_CHORD];
+    unsigned int modifiers[INPUT_MAX_CHORD];
+    int length;
+    const InputAction *action;
+    InputArg arg;
 } Keybind;
 
+// Trie node; nodes 0..num_modes-1 are the roots of the modes
+typedef struct {
+    int binding;                   // Index into keybinds for a leaf, -1 for a prefix
+    int num_children;
+} KeyNode;
+
+// Trie edge: (parent node, keycode, modifiers with the lock bits stripped)
+typedef struct {
+    int parent;
+    KeyCode keycode;               // 0 marks an empty slot
+    unsigned int modifiers;
+    int node;
+} KeymapEntry;
+
+typedef struct {
+    XIM xim;
+    XIC xic;
+} InputMethod;
+
+#define KEYMAP_SLOTS 512           // Power of two, open addressing
+
 typedef struct {
     Keybind *keybinds;
     int num_keybinds;
     int capacity;
+    char *modes[INPUT_MAX_MODES];      // Mode names; modes[0] is the default mode
+    int num_modes;
+    KeyNode *nodes;
+    int num_nodes;
+    int nodes_capacity;
+    KeymapEntry keymap[KEYMAP_SLOTS];  // Trie edges, one probe per key press
+    bool modifier_keycodes[256];       // Keycodes that only change modifiers
+    unsigned int lock_masks[8];        // Every combination of the lock modifiers
+    int num_lock_masks;
+    int mode;                          // Active mode
+    int current;                       // Trie position, the mode root when idle
+    bool keyboard_grabbed;
     XIC xic;
     XIM xim;
     bool mouse_dragging;
-    Window drag_window;
+    ClientHandle drag_client;
     int drag_start_x;
     int drag_start_y;
 } InputManager;
@@ -29,10 +83,13 @@ void input_manager_cleanup(void);
 void input_handle_key(XEvent *ev);
 void input_handle_button(XEvent *ev);
 void input_handle_motion(XEvent *ev);
-void input_register_keybind(KeySym key, unsigned int modifiers, void (*callback)(void));
+void input_apply_keybinds(void);
+void input_rebuild_keymap(void);
+void input_set_mode(int mode);
+InputMethod *input_method_open(void);
+void input_method_publish(InputMethod *im);
 
 // Global input manager instance
 extern InputManager input_manager;
 
 #endif
-    
\ No newline at end of file
@@ -0,0 +1,24 @@
+#ifndef CANOPY_IPC_H
+#define CANOPY_IPC_H
+
+#include "ipc_protocol.h"
+#include <X11/Xlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define IPC_MAX_CLIENTS 16
+#define IPC_OUT_BUFFER (64 * 1024)     // Per connection; events past this are dropped
+#define IPC_REPLY_RESERVE 1024         // Kept free in the out buffer for command replies
+
+bool ipc_init(void);
+void ipc_cleanup(void);
+
+/* Queue an event for the subscribers; sent with the next ipc_flush(). */
+void ipc_publish(uint32_t type, Window window, uint32_t value, const char *title);
+
+/* Send this iteration's batch and retry pending writes; once per main loop iteration. */
+void ipc_flush(void);
+
+void ipc_dump_stats(void);
+
+#endif
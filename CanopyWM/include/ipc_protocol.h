@@ -0,0 +1,110 @@
+#ifndef CANOPY_IPC_PROTOCOL_H
+#define CANOPY_IPC_PROTOCOL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Wire format of the CanopyWM control socket, shared by the WM, canopyctl
+ * and the IPC benchmark. Every message is an IpcHeader followed by length
+ * bytes of payload, all integers in host byte order (the socket is local).
+ *
+ * Commands are answered in order with one IPC_MSG_REPLY each. Subscribers
+ * receive at most one IPC_MSG_EVENTS batch per WM main loop iteration; a
+ * subscriber that cannot keep up loses events and is sent IPC_MSG_GAP with
+ * the number lost before the next batch it has room for.
+ */
+#define CANOPY_SOCKET_ENV "CANOPY_SOCKET"
+#define CANOPY_SOCKET_NAME "canopy-wm.sock"
+#define IPC_MAX_PAYLOAD 4096
+
+enum {
+    // Client to WM
+    IPC_MSG_FOCUS = 1,             // IpcWindowArg
+    IPC_MSG_MOVE,                  // IpcMoveArg
+    IPC_MSG_CLOSE,                 // IpcWindowArg
+    IPC_MSG_WORKSPACE,             // uint32_t index
+    IPC_MSG_RELOAD,                // no payload
+    IPC_MSG_SUBSCRIBE,             // uint32_t mask of IPC_EVENT_MASK() bits, 0 unsubscribes
+    IPC_MSG_XSTATS,                // no payload; answered with IPC_MSG_XSTATS_DATA, then the reply
+    IPC_MSG_PING_STATS,            // no payload; answered with IPC_MSG_PING_STATS_DATA, then the reply
+
+    // WM to client
+    IPC_MSG_REPLY = 0x100,         // int32_t status
+    IPC_MSG_EVENTS,                // IpcEvent records back to back
+    IPC_MSG_GAP,                   // uint32_t events dropped
+    IPC_MSG_XSTATS_DATA,           // IpcXStats records back to back
+    IPC_MSG_PING_STATS_DATA,       // IpcPingStats records back to back
+};
+
+enum {
+    IPC_OK = 0,
+    IPC_ERR_MALFORMED = -1,
+    IPC_ERR_UNKNOWN = -2,          // Unknown message type
+    IPC_ERR_NO_WINDOW = -3,        // Not a managed client
+    IPC_ERR_UNSUPPORTED = -4,
+    IPC_ERR_BUSY = -5,             // No room for the answer; read pending messages and retry
+};
+
+// Event types match the WM_EVENT_* values of wm_events.h
+#define IPC_EVENT_MASK(type) (1u << (type))
+#define IPC_EVENT_ALL 0xffffffffu
+
+typedef struct {
+    uint32_t length;               // Payload bytes following the header
+    uint16_t type;                 // IPC_MSG_*
+    uint16_t reserved;
+} IpcHeader;
+
+typedef struct {
+    uint32_t window;               // Client or frame XID
+} IpcWindowArg;
+
+typedef struct {
+    uint32_t window;
+    int32_t x, y;
+} IpcMoveArg;
+
+// One event in an IPC_MSG_EVENTS batch; title_len bytes of UTF-8 follow
+typedef struct {
+    uint16_t type;                 // WM_EVENT_*
+    uint16_t title_len;
+    uint32_t window;
+    uint32_t value;
+} IpcEvent;
+
+// X requests made for one source (an X event type, IPC commands or the main loop)
+typedef struct {
+    uint32_t source;
+    char name[28];                 // NUL-terminated
+    uint64_t count;                // Events or commands handled
+    uint64_t requests;
+    uint64_t round_trips;
+} IpcXStats;
+
+// _NET_WM_PING reply latency of one application (WM_CLASS class)
+#define IPC_PING_BUCKETS 14
+typedef struct {
+    char app[32];                  // NUL-terminated
+    uint32_t replies;
+    uint32_t timeouts;             // Pings left unanswered past the WM's threshold
+    uint32_t max_ms;
+    uint32_t reserved;
+    uint32_t buckets[IPC_PING_BUCKETS];    // Bucket i: below 2^i ms, the last open
+} IpcPingStats;
+
+/* $CANOPY_SOCKET, else $XDG_RUNTIME_DIR/canopy-wm.sock, else a per-user path in /tmp */
+static inline void ipc_socket_path(char *buf, size_t size) {
+    const char *path = getenv(CANOPY_SOCKET_ENV);
+    const char *runtime = getenv("XDG_RUNTIME_DIR");
+    if (path && path[0])
+        snprintf(buf, size, "%s", path);
+    else if (runtime && runtime[0] == '/')
+        snprintf(buf, size, "%s/%s", runtime, CANOPY_SOCKET_NAME);
+    else
+        snprintf(buf, size, "/tmp/canopy-wm-%d.sock", (int)getuid());
+}
+
+#endif
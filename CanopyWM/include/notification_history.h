@@ -0,0 +1,55 @@
+#ifndef CANOPY_NOTIFICATION_HISTORY_H
+#define CANOPY_NOTIFICATION_HISTORY_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * On-disk layout of $XDG_STATE_HOME/canopy/notifications.ring.
+ *
+ * The file is a header followed by a fixed number of fixed-size slots, so it
+ * never grows past that size; it is never shrunk either, because CanopyDE
+ * may have it mapped. Record n (counting from 1) lives in slot (n - 1) % slot_count.
+ * A slot's seq is 0 while it is being written and n once it is complete;
+ * readers compare seq before and after copying to detect torn records.
+ *
+ * CanopyDE maps the same file read-only; keep this layout in sync with
+ * CanopyDE/include/notification_history.h.
+ */
+#define NOTIFICATION_HISTORY_FILE "notifications.ring"
+#define NOTIFICATION_HISTORY_MAGIC 0x31484e43u /* "CNH1" */
+#define NOTIFICATION_HISTORY_VERSION 1
+#define NOTIFICATION_HISTORY_SLOTS 1024
+#define NOTIFICATION_HISTORY_APP_LEN 64
+#define NOTIFICATION_HISTORY_SUMMARY_LEN 256
+#define NOTIFICATION_HISTORY_BODY_LEN 1024
+
+typedef struct {
+    _Atomic uint64_t seq;
+    int64_t timestamp;      // Unix time in seconds
+    uint32_t urgency;       // NotifyUrgency
+    char app_name[NOTIFICATION_HISTORY_APP_LEN];
+    char summary[NOTIFICATION_HISTORY_SUMMARY_LEN];
+    char body[NOTIFICATION_HISTORY_BODY_LEN];
+} NotificationHistoryRecord;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    _Atomic uint64_t head;  // Number of records ever written
+} NotificationHistoryHeader;
+
+bool notification_history_open(void);
+void notification_history_close(void);
+void notification_history_append(const char *app_name, const char *summary,
+                                 const char *body, unsigned int urgency);
+
+// app_name's newest records, newest first; returns how many were copied
+unsigned int notification_history_find_by_app(const char *app_name,
+                                               NotificationHistoryRecord *out,
+                                               unsigned int max);
+
+#endif
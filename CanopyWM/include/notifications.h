@@ -10,28 +10,63 @@
 #define MAX_NOTIFICATIONS 32
 #define NOTIFICATION_TIMEOUT 5000 // 5 seconds
 
+// Per-sender token bucket: a sender may burst up to NOTIFICATION_RATE_BURST
+// notifications, then gets NOTIFICATION_RATE_PER_SEC new ones per second.
+#define MAX_NOTIFICATION_SENDERS 32
+#define NOTIFICATION_RATE_BURST 5
+#define NOTIFICATION_RATE_PER_SEC 2.0
+#define NOTIFICATION_APP_NAME_LEN 64
+
 typedef struct {
     NotifyNotification *notification;
+    char *app_name;
     char *summary;
     char *body;
     time_t timestamp;
     int timeout;
+    unsigned int count;     // Number of identical notifications coalesced into this one
+    bool dirty;             // Needs to be (re)shown on the next flush
 } NotificationEntry;
 
+typedef struct {
+    char app_name[NOTIFICATION_APP_NAME_LEN];
+    double tokens;
+    struct timespec last_refill;
+    unsigned long received;
+    unsigned long shown;
+    unsigned long coalesced;
+    unsigned long dropped;
+} NotificationSender;
+
 typedef struct {
     NotificationEntry entries[MAX_NOTIFICATIONS];
     int count;
+    NotificationSender senders[MAX_NOTIFICATION_SENDERS];
+    int num_senders;
+    NotifyNotification *retired[MAX_NOTIFICATIONS];  // Removed popups, closed on the next flush
+    int num_retired;
+    bool layout_dirty;      // At least one entry is waiting for notification_flush()
+    bool flushing;          // A flush job is talking to the notification daemon
     bool initialized;
 } NotificationManager;
 
 // Function declarations
 void notification_manager_init(void);
+bool notification_manager_connect(void);
+void notification_manager_publish(bool connected);
 void notification_manager_cleanup(void);
 void notification_show(const char *summary, const char *body, int timeout);
+// Rate limiting and coalescing are keyed on app_name, so every subsystem
+// should pass its own name; NULL shares the WM's default bucket with
+// notification_show().
+void notification_show_from(const char *app_name, NotifyUrgency urgency,
+                            const char *summary, const char *body, int timeout);
+void notification_flush(void);
 void notification_clear_expired(void);
 void notification_clear_all(void);
+void notification_dump_stats(void);
 
 // Global notification manager instance
 extern NotificationManager notification_manager;
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,40 @@
+#ifndef CANOPY_PING_H
+#define CANOPY_PING_H
+
+#include "client.h"
+
+/*
+ * _NET_WM_PING responsiveness monitor. Clients that list _NET_WM_PING in
+ * WM_PROTOCOLS are pinged when they get focus and every PING_INTERVAL_MS
+ * while they keep it. Reply latency goes into a histogram per application
+ * (the WM_CLASS class); a client that leaves a ping unanswered for
+ * PING_TIMEOUT_MS is marked not responding until it replies.
+ */
+#define PING_INTERVAL_MS 2000.0
+#define PING_TIMEOUT_MS 5000.0
+#define PING_BUCKETS 14                // Powers of two from 1 ms; must match IPC_PING_BUCKETS
+#define PING_MAX_APPS 64
+#define PING_APP_NAME 32
+
+typedef struct {
+    char app[PING_APP_NAME];           // WM_CLASS class; the last slot is "other", for the overflow
+    unsigned long replies;
+    unsigned long timeouts;
+    double max_ms;
+    unsigned long buckets[PING_BUCKETS];   // Bucket i: latency below 2^i ms, the last open
+} PingAppStats;
+
+/* Ping client unless it does not support pings or one is outstanding. */
+void ping_client(Client *client);
+
+/* A _NET_WM_PING reply reached the root window. */
+void ping_reply(Window window, long token);
+
+/* Periodic pings of the focused client and timeouts; once per main loop iteration. */
+void ping_tick(void);
+
+int ping_app_count(void);
+const PingAppStats *ping_app(int index);
+void ping_dump_stats(void);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef CANOPY_PROPS_H
+#define CANOPY_PROPS_H
+
+#include <X11/Xlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Per-client cache of the window properties the WM reads. All slots are
+ * requested in one pipelined batch when a client is managed; PropertyNotify
+ * invalidates only the slot of the atom that changed, which is refetched on
+ * its next read. Every slot is read with a bounded length, so large
+ * properties such as _NET_WM_ICON are never transferred.
+ */
+enum {
+    PROP_NET_WM_NAME,              // UTF-8 title
+    PROP_WM_NAME,                  // Legacy title, used without _NET_WM_NAME
+    PROP_WM_CLASS,
+    PROP_WM_HINTS,
+    PROP_WM_NORMAL_HINTS,
+    PROP_WM_PROTOCOLS,
+    PROP_NET_WM_WINDOW_TYPE,
+    PROP_NET_WM_STATE,
+    PROP_NET_WM_PID,
+    PROP_WM_CLIENT_MACHINE,        // Host the client runs on, qualifying _NET_WM_PID
+    PROP_COUNT
+};
+
+typedef struct {
+    void *data;                    // NULL if the property is not set
+    uint32_t items;                // In units of format
+    uint8_t format;                // 8, 16 or 32; 32-bit items are stored as uint32_t
+    Atom type;
+} PropValue;
+
+typedef struct {
+    uint32_t valid;                // Bit per PROP_* slot holding the current value
+    PropValue values[PROP_COUNT];
+} ClientProps;
+
+/* Fetch every slot in one round trip; called when a client is managed. */
+void props_fetch_all(ClientProps *props, Window window);
+
+/* Mark the slot of atom stale; false if the atom is not cached. */
+bool props_invalidate(ClientProps *props, Atom atom);
+
+/* The cached value of a slot, refetched first if it was invalidated. */
+const PropValue *props_get(ClientProps *props, Window window, int slot);
+
+void props_clear(ClientProps *props);
+
+// Decoded accessors
+char *props_title(ClientProps *props, Window window);     // malloc'd, NULL if unset
+bool props_has_protocol(ClientProps *props, Window window, Atom protocol);
+bool props_has_state(ClientProps *props, Window window, Atom state);      // _NET_WM_STATE
+bool props_is_urgent(ClientProps *props, Window window);
+pid_t props_pid(ClientProps *props, Window window);
+bool props_machine_is(ClientProps *props, Window window, const char *host);  // false if unset
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef CANOPY_RESTART_H
+#define CANOPY_RESTART_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// The restart state travels to the new image in a memfd named by this variable
+#define CANOPY_RESTORE_ENV "CANOPY_RESTORE_FD"
+
+#define RESTART_MAGIC 0x53524e43   // "CNRS"
+#define RESTART_VERSION 2
+
+#define RESTART_CLIENT_FULLSCREEN (1u << 0)
+#define RESTART_CLIENT_FLOATING   (1u << 1)
+#define RESTART_CLIENT_FOCUSED    (1u << 2)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t client_size;          // sizeof(RestartClient) of the writer
+    uint32_t num_clients;
+    int32_t de_pid;                // Our DE child, adopted instead of respawned
+    int32_t nested_server_pid;     // Xephyr/Xvfb of --debug/--headless, or -1
+    uint32_t desktop_window;       // Destroyed once the new one is up
+    uint32_t gc;                   // GContext of the old wm.gc, freed
+} RestartHeader;
+
+// One managed client, in client slot order
+typedef struct {
+    uint32_t window;
+    uint32_t frame;
+    int32_t x, y;
+    uint32_t width, height;
+    int32_t saved_x, saved_y;
+    uint32_t saved_width, saved_height;
+    uint32_t flags;                // RESTART_CLIENT_*
+    uint32_t stack;                // Position in the stacking order, 0 is the bottom
+} RestartClient;
+
+/* Remember how to exec ourselves; nested_server_pid is -1 without one. */
+void restart_init(char **argv, pid_t nested_server_pid);
+
+/*
+ * Serialize the session and exec the WM binary in place. The frames are
+ * kept alive across the exec, so clients never see an unmap. Only returns
+ * on failure, with the session untouched.
+ */
+bool restart_exec(void);
+
+/* Read the state left by restart_exec(); false on a normal start. */
+bool restart_load(void);
+const RestartHeader *restart_state(void);
+
+/*
+ * Re-adopt the frames of the previous image and free the desktop window and
+ * GC it left behind; called from client_manager_init().
+ */
+void restart_restore_clients(void);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef CANOPY_TRACE_H
+#define CANOPY_TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Startup timeline tracing. When CANOPY_TRACE_FILE is set, CanopyWM and
+ * CanopyDE append Chrome trace-event JSON ("X" complete events on
+ * CLOCK_MONOTONIC) to that file, so one login opens as a single timeline in
+ * chrome://tracing or ui.perfetto.dev. The format must match
+ * CanopyDE/include/trace.h. Without the variable every call is a no-op.
+ */
+#define CANOPY_TRACE_ENV "CANOPY_TRACE_FILE"
+
+// Open the trace file; truncate resets it, which the first process does
+void trace_init(const char *process_name, int truncate);
+void trace_close(void);
+
+// Returns the start timestamp in microseconds, or 0 when tracing is off
+uint64_t trace_begin(void);
+void trace_end(const char *name, uint64_t start);
+void trace_instant(const char *name);
+
+// Record a phase around a statement, e.g. TRACE_PHASE("wm_init", wm_init())
+#define TRACE_PHASE(name, stmt) do {        \
+        uint64_t trace_start_ = trace_begin(); \
+        stmt;                                  \
+        trace_end(name, trace_start_);         \
+    } while (0)
+
+#endif
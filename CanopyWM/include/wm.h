@@ -11,6 +11,8 @@
 #include <systemd/sd-bus.h>
 #include <stdbool.h>
 
+#define WM_PROP_MAX_LENGTH 4096       // Longest property read by wm_get_window_prop(), in 32-bit units
+
 // Atom indices
 enum {
     WM_PROTOCOLS,
@@ -29,6 +31,13 @@ enum {
     NET_WM_WINDOW_TYPE_SPLASH,
     NET_WM_WINDOW_TYPE_DIALOG,
     NET_WM_WINDOW_TYPE_NORMAL,
+    NET_SUPPORTED,
+    NET_SUPPORTING_WM_CHECK,
+    NET_CLIENT_LIST,
+    NET_CLIENT_LIST_STACKING,
+    NET_WM_PID,
+    NET_WM_PING,
+    UTF8_STRING,
     ATOM_COUNT
 };
 
@@ -56,6 +65,7 @@ typedef struct {
     cairo_t *desktop_cr;
     int desktop_width;
     int desktop_height;
+    cairo_surface_t *wallpaper;    // Decoded wallpaper image, NULL for a plain background
 
     // Window dragging state
     bool dragging;             // Whether we're currently dragging a window
@@ -81,6 +91,8 @@ void wm_handle_destroy_notify(XDestroyWindowEvent *ev);
 void wm_handle_enter_notify(XCrossingEvent *ev);
 void wm_handle_button_press(XButtonEvent *ev);
 void wm_handle_key_press(XKeyEvent *ev);
+void wm_handle_expose(XExposeEvent *ev);
+void wm_handle_mapping_notify(XMappingEvent *ev);
 
 // Window management (the prototypes below can be expanded as needed)
 void wm_frame_window(Window w);
@@ -92,7 +104,15 @@ void wm_maximize_window(Window w);
 void wm_minimize_window(Window w);
 void wm_close_window(Window w);
 
+// Configuration
+void wm_apply_config(unsigned int changed);
+void wm_load_wallpaper(void);
+void wm_reload_wallpaper(void);
+void wm_render_wallpaper(void);
+
 // Utility functions
+sd_bus *wm_bus_connect(void);
+void wm_bus_publish(sd_bus *bus);
 void wm_grab_keys(void);
 void wm_grab_buttons(void);
 Atom wm_get_atom(const char *name);
@@ -0,0 +1,69 @@
+#ifndef CANOPY_WM_EVENTS_H
+#define CANOPY_WM_EVENTS_H
+
+#include <X11/Xlib.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Client events for CanopyDE: a single-producer/single-consumer ring in a
+ * memfd. The WM appends records and bumps head, the DE consumes them and
+ * bumps tail; an eventfd wakes the DE once per main loop iteration. Both
+ * descriptors reach the DE by inheritance, their numbers in the environment.
+ *
+ * CanopyDE maps the same memfd; keep this layout in sync with
+ * CanopyDE/include/wm_events.h.
+ */
+#define CANOPY_EVENT_RING_ENV "CANOPY_EVENT_RING_FD"
+#define CANOPY_EVENT_NOTIFY_ENV "CANOPY_EVENT_NOTIFY_FD"
+#define WM_EVENTS_MAGIC 0x31455743u /* "CWE1" */
+#define WM_EVENTS_VERSION 1
+#define WM_EVENTS_SLOTS 512        // Power of two
+#define WM_EVENTS_TITLE_LEN 112
+
+enum {
+    WM_EVENT_CLIENT_ADD = 1,
+    WM_EVENT_CLIENT_REMOVE,
+    WM_EVENT_CLIENT_TITLE,
+    WM_EVENT_CLIENT_FOCUS,         // window is None when nothing has focus
+    WM_EVENT_CLIENT_URGENT,        // value is the new urgency
+    WM_EVENT_RESET,                // Forget every client; a snapshot follows
+    WM_EVENT_CLIENT_NOT_RESPONDING, // value is 1 once a ping goes unanswered, 0 when answered
+};
+
+typedef struct {
+    uint32_t type;
+    uint32_t window;
+    uint32_t value;
+    uint32_t title_len;
+    char title[WM_EVENTS_TITLE_LEN];   // UTF-8, not NUL-terminated
+} WmEventRecord;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    _Alignas(64) _Atomic uint64_t head;    // Written by the WM only
+    _Alignas(64) _Atomic uint64_t tail;    // Written by the DE only
+    _Alignas(64) WmEventRecord records[WM_EVENTS_SLOTS];
+} WmEventRing;
+
+bool wm_events_init(void);
+void wm_events_cleanup(void);
+
+/* Queue an event; never blocks. A full ring is resynced with a snapshot
+   that wm_events_flush() streams in as the DE drains the ring. */
+void wm_events_publish(uint32_t type, Window window, uint32_t value, const char *title);
+
+/* Wake the DE if anything was published; once per main loop iteration. */
+void wm_events_flush(void);
+
+/* Empty the ring and queue a snapshot of every client, for a fresh DE. */
+void wm_events_reset(void);
+
+/* Clear or restore close-on-exec, for handing the ring to an exec'd image. */
+void wm_events_set_inheritable(bool inheritable);
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <X11/Xlib.h>
 #include <stdbool.h>
+#include <time.h>
 
 // Communication atoms
 #define CANOPY_ATOM_PREFIX "_CANOPY_"
@@ -13,5 +14,6 @@ void wm_interface_init(Display *display);
 void wm_interface_cleanup(void);
 void wm_interface_handle_message(XEvent *ev);
 bool wm_interface_is_de_ready(void);
+struct timespec wm_interface_de_ready_time(void);
 
 #endif
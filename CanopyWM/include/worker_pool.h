@@ -0,0 +1,24 @@
+#ifndef CANOPY_WORKER_POOL_H
+#define CANOPY_WORKER_POOL_H
+
+#include <stdbool.h>
+
+#define WORKER_POOL_THREADS 4
+
+/* Runs on a worker thread; must not touch WM state or the X connection
+   unless the called code is thread-safe. Returns the result to publish. */
+typedef void *(*WorkerFunc)(void *data);
+
+/* Runs on the main thread, from the event loop, with the worker's result. */
+typedef void (*WorkerDoneFunc)(void *result);
+
+bool worker_pool_init(void);
+void worker_pool_cleanup(void);
+
+/* Queue work; done is called on the main thread once it has finished. */
+bool worker_pool_submit(const char *name, WorkerFunc func, WorkerDoneFunc done, void *data);
+
+/* Number of submitted jobs whose done callback has not run yet. */
+int worker_pool_pending(void);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef CANOPY_XERROR_H
+#define CANOPY_XERROR_H
+
+#include "client.h"
+#include <X11/Xlib.h>
+
+/*
+ * Asynchronous X error handling. Errors are counted per request and error
+ * code and attributed to a client, by their resource or else by the request
+ * sequence number: xerror_mark() records where the requests for a client
+ * start. The Xlib callback may run on any thread, so it only buffers the
+ * error; xerror_flush() counts and attributes it on the main thread and
+ * drops a client whose window turns out to be gone, so no XSync is needed
+ * after requests on windows that may have died.
+ */
+#define XERROR_MARKS 64                // Recent request ranges remembered
+#define XERROR_MAX_RECORDS 256         // Errors buffered between flushes
+
+void xerror_init(Display *dpy);
+
+/* Requests from the next sequence number on are made on behalf of client. */
+void xerror_mark(const Client *client);
+
+/* Drop the clients found dead since the last call; once per main loop iteration. */
+void xerror_flush(void);
+
+void xerror_dump_stats(void);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef CANOPY_XSTATS_H
+#define CANOPY_XSTATS_H
+
+#include <X11/Xlib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * X request accounting. Requests are counted per triggering source (an X
+ * event type, an IPC command or the per-iteration flushes) from the
+ * sequence number before and after the work. Calls that block on a reply
+ * are wrapped in X_ROUND_TRIP() and counted per call site as well, so a
+ * new synchronous call on a hot path shows up in the stats dump and in
+ * ipc_bench.
+ */
+#define XSTATS_SOURCE_IPC 128          // An IPC command
+#define XSTATS_SOURCE_LOOP 129         // Flushes at the end of a main loop iteration
+#define XSTATS_SOURCES 130             // X event types are below 128
+#define XSTATS_MAX_SITES 128
+
+typedef struct {
+    uint64_t count;                    // Events or commands handled
+    uint64_t requests;
+    uint64_t round_trips;
+} XStatsSource;
+
+/* Count one blocking round trip for this call site, then make the call */
+#define X_ROUND_TRIP(call) (xstats_round_trip(__FILE__, __LINE__, #call), (call))
+
+void xstats_round_trip(const char *file, int line, const char *call);
+
+/* Bracket the work done for one source; not nested. */
+void xstats_begin(int source);
+void xstats_end(void);
+
+const XStatsSource *xstats_source(int source);
+
+/* Event type name, "ipc" or "loop"; buf is used for unnamed event types */
+const char *xstats_source_name(int source, char *buf, size_t size);
+
+void xstats_dump_stats(void);
+
+#endif
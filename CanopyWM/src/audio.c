@@ -3,19 +3,39 @@
 
 static AudioManager audio_manager;
 
-void audio_manager_init(void) {
-    snd_mixer_open(&audio_manager.mixer, 0);
-    snd_mixer_attach(audio_manager.mixer, "default");
-    snd_mixer_selem_register(audio_manager.mixer, NULL, NULL);
-    snd_mixer_load(audio_manager.mixer);
+/* Open and load the mixer; touches no shared state, so it may run on a
+   worker thread. Returns NULL if there is no usable mixer. */
+AudioManager *audio_manager_load(void) {
+    AudioManager *loaded = calloc(1, sizeof(*loaded));
+    if (!loaded) return NULL;
+
+    if (snd_mixer_open(&loaded->mixer, 0) < 0) {
+        free(loaded);
+        return NULL;
+    }
+    snd_mixer_attach(loaded->mixer, "default");
+    snd_mixer_selem_register(loaded->mixer, NULL, NULL);
+    snd_mixer_load(loaded->mixer);
     
     snd_mixer_selem_id_t *sid;
     snd_mixer_selem_id_alloca(&sid);
     snd_mixer_selem_id_set_index(sid, 0);
     snd_mixer_selem_id_set_name(sid, "Master");
     
-    audio_manager.volume_elem = snd_mixer_find_selem(audio_manager.mixer, sid);
-    audio_manager.muted = false;
+    loaded->volume_elem = snd_mixer_find_selem(loaded->mixer, sid);
+    loaded->muted = false;
+    return loaded;
+}
+
+/* Take over a mixer from audio_manager_load(); main thread only */
+void audio_manager_publish(AudioManager *loaded) {
+    if (!loaded) return;
+    audio_manager = *loaded;
+    free(loaded);
+}
+
+void audio_manager_init(void) {
+    audio_manager_publish(audio_manager_load());
 }
 void audio_manager_cleanup(void) {
     if (audio_manager.mixer) {
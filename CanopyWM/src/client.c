@@ -1,62 +1,434 @@
-
 // client.c
 #include "client.h"
+#include "wm.h"
+#include "config.h"
+#include "cpu_policy.h"
+#include "props.h"
+#include "ping.h"
+#include "restart.h"
+#include "ewmh.h"
+#include "wm_events.h"
+#include "xerror.h"
+#include "xstats.h"
+#include "log.h"
 #include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xatom.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#define CLIENT_WINDOW_EVENTS (PropertyChangeMask | EnterWindowMask | FocusChangeMask)
+
+// Global client manager instance
+ClientManager client_manager;
+
+static int titles_pending;     // Clients with a deferred title update
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
 
 Client *client_create(Display *dpy, Window window, int x, int y, unsigned int width, unsigned int height) {
-    Client *client = (Client *)malloc(sizeof(Client));
-    if (!client) return NULL;
-
-    client->window = window;
-    client->frame = XCreateSimpleWindow(dpy, DefaultRootWindow(dpy), x, y, width, height, 0, 0, 0);
-    client->x = x;
-    client->y = y;
-    client->width = width;
-    client->height = height;
-    client->is_fullscreen = false;
-    client->is_floating = false;
-    client->needs_redraw = false;
-    client->title = NULL;
-    client->next = NULL;
+    Window frame = XCreateSimpleWindow(dpy, DefaultRootWindow(dpy), x, y,
+                                       width, height + config.window.titlebar_height,
+                                       config.window.border_width,
+                                       config.window.border_color,
+                                       config.window.titlebar_color);
+    Client *client = client_slot_alloc(window, frame);
+    if (!client) {
+        XDestroyWindow(dpy, frame);
+        return NULL;
+    }
 
+    CLIENT_X(client) = x;
+    CLIENT_Y(client) = y;
+    CLIENT_WIDTH(client) = width;
+    CLIENT_HEIGHT(client) = height;
     return client;
 }
 
 void client_destroy(Display *dpy, Client *client) {
     if (client) {
-        if (client->title) free(client->title);
+        if (client->title_pending) titles_pending--;
+        props_clear(&client->props);
         XDestroyWindow(dpy, client->frame);
-        free(client);
+        client_slot_free(client);
     }
 }
 
 Client *client_from_window(Display *dpy, Window win) {
-    // Placeholder: Replace with actual logic to retrieve client from window
     (void)dpy;
-    (void)win;
-    return NULL;
+    return client_find_by_window(win);
 }
 
 void client_set_title(Display *dpy, Client *client, const char *title) {
-    if (client->title) free(client->title);
-    client->title = strdup(title);
+    client_title_set(&client->title, title);
     XStoreName(dpy, client->window, title);
 }
 
-void client_focus(Display *dpy, Client *client) {
-    XSetInputFocus(dpy, client->window, RevertToPointerRoot, CurrentTime);
+void client_focus(Client *client) {
+    Client *previous = client_manager.focused;
+
+    xerror_mark(client);
+    XSetInputFocus(wm.display, client->window, RevertToPointerRoot, CurrentTime);
+    XRaiseWindow(wm.display, client->frame);
+    ewmh_client_raised(client->window);
+    client_manager.focused = client;
+    wm.focused_window = client->window;
+    ewmh_set_active(client->window);
+    if (previous != client) {
+        wm_events_publish(WM_EVENT_CLIENT_FOCUS, client->window, 0, NULL);
+        ping_client(client);
+        cpu_policy_changed();
+    }
+
+    if (previous && previous != client)
+        client_draw_decorations(previous);
+    client_draw_decorations(client);
 }
 
 void client_resize(Display *dpy, Client *client, unsigned int width, unsigned int height) {
-    client->width = width;
-    client->height = height;
+    xerror_mark(client);
+    CLIENT_WIDTH(client) = width;
+    CLIENT_HEIGHT(client) = height;
+    XResizeWindow(dpy, client->frame, width, height + config.window.titlebar_height);
     XResizeWindow(dpy, client->window, width, height);
 }
 
-void client_move(Display *dpy, Client *client, int x, int y) {
-    client->x = x;
-    client->y = y;
-    XMoveWindow(dpy, client->window, x, y);
+void client_move(Client *client, int x, int y) {
+    xerror_mark(client);
+    CLIENT_X(client) = x;
+    CLIENT_Y(client) = y;
+    XMoveWindow(wm.display, client->frame, x, y);
+}
+
+/* -- Client manager -- */
+
+void client_manager_init(Display *dpy) {
+    client_manager.focused = NULL;
+    client_manager.num_clients = 0;
+
+    /* Frames kept alive by a restart come first, so they are not framed again. */
+    restart_restore_clients();
+
+    /* Adopt windows that were already mapped before we started. */
+    Window root_ret, parent_ret, *children = NULL;
+    unsigned int nchildren = 0;
+    if (!X_ROUND_TRIP(XQueryTree(dpy, wm.root, &root_ret, &parent_ret, &children, &nchildren)))
+        return;
+
+    for (unsigned int i = 0; i < nchildren; i++) {
+        XWindowAttributes attr;
+        if (X_ROUND_TRIP(XGetWindowAttributes(dpy, children[i], &attr)) &&
+            !attr.override_redirect && attr.map_state == IsViewable) {
+            client_add(children[i]);
+        }
+    }
+    if (children) XFree(children);
+}
+
+void client_manager_cleanup(Display *dpy) {
+    for (Client *c = client_first(); c; c = client_next(c)) {
+        /* Hand the window back to the root so it survives us. */
+        XReparentWindow(dpy, c->window, wm.root, CLIENT_X(c), CLIENT_Y(c));
+        XRemoveFromSaveSet(dpy, c->window);
+        client_destroy(dpy, c);
+    }
+    client_slab_cleanup();
+    client_manager.focused = NULL;
+    client_manager.num_clients = 0;
+}
+
+/* Select events on the frame and client, and count the client in */
+static void client_attach(Client *c) {
+    xerror_mark(c);
+    XSelectInput(wm.display, c->frame,
+                 SubstructureNotifyMask | ExposureMask | ButtonPressMask | EnterWindowMask);
+    XSelectInput(wm.display, c->window, CLIENT_WINDOW_EVENTS);
+    XAddToSaveSet(wm.display, c->window);
+    props_fetch_all(&c->props, c->window);
+
+    client_manager.num_clients++;
+    ewmh_client_added(c->window);
+    cpu_policy_changed();
+    wm_events_publish(WM_EVENT_CLIENT_ADD, c->window, 0, NULL);
+}
+
+/* Frame a newly mapped window and start managing it */
+Client *client_add(Window window) {
+    Client *c = client_find_by_window(window);
+    if (c) return c;
+
+    XWindowAttributes attr;
+    if (!X_ROUND_TRIP(XGetWindowAttributes(wm.display, window, &attr)))
+        return NULL;
+
+    c = client_create(wm.display, window, attr.x, attr.y, attr.width, attr.height);
+    if (!c) return NULL;
+
+    client_attach(c);
+    XReparentWindow(wm.display, window, c->frame, 0, config.window.titlebar_height);
+    XMapWindow(wm.display, c->frame);
+
+    client_update_title(c);
+    client_focus(c);
+    // A client may ask for fullscreen before it is mapped
+    if (props_has_state(&c->props, window, wm.atoms[NET_WM_STATE_FULLSCREEN]))
+        client_set_fullscreen(c, true);
+    return c;
+}
+
+/*
+ * Manage a window framed by the image before a restart. The frame is kept
+ * as it is: nothing is reparented, mapped or restacked, only the event
+ * selections that died with the old connection are made again. The caller
+ * restores geometry.
+ */
+Client *client_adopt(Window window, Window frame) {
+    Client *c = client_slot_alloc(window, frame);
+    if (!c) return NULL;
+
+    client_attach(c);
+    client_update_title(c);
+    return c;
+}
+
+/* Stop managing a window, e.g. after it was destroyed */
+void client_remove(Window window) {
+    Client *c = client_slot_find(window);
+    if (!c || c->window != window)
+        return;
+
+    client_manager.num_clients--;
+    ewmh_client_removed(window);
+    cpu_policy_changed();
+    wm_events_publish(WM_EVENT_CLIENT_REMOVE, window, 0, NULL);
+    if (client_manager.focused == c) {
+        client_manager.focused = NULL;
+        wm.focused_window = None;
+        wm_events_publish(WM_EVENT_CLIENT_FOCUS, None, 0, NULL);
+    }
+    client_destroy(wm.display, c);
+}
+
+/* Find the client owning a window; matches both client and frame windows */
+Client *client_find_by_window(Window window) {
+    return client_slot_find(window);
+}
+
+/* Take the window title from the property cache, preferring the UTF-8 _NET_WM_NAME */
+void client_update_title(Client *client) {
+    char *title = props_title(&client->props, client->window);
+
+    if (client->title_pending) {
+        client->title_pending = false;
+        titles_pending--;
+    }
+    client->title_time = now_ms();
+
+    client_title_set(&client->title, title);
+    free(title);
+    client_draw_decorations(client);
+    wm_events_publish(WM_EVENT_CLIENT_TITLE, client->window, 0, client_title(client));
+}
+
+/*
+ * Rate-limit title changes: the first change in a frame is applied at once,
+ * later ones only mark the client pending and client_flush_titles() shows
+ * the final title once the frame is over.
+ */
+void client_title_changed(Client *client) {
+    client->title_changes++;
+    if (client->title_pending) {
+        client->titles_suppressed++;
+        return;
+    }
+    if (now_ms() - client->title_time >= CLIENT_TITLE_INTERVAL_MS) {
+        client_update_title(client);
+        return;
+    }
+    client->title_pending = true;
+    titles_pending++;
+}
+
+/* Apply deferred title updates that are due; once per main loop iteration */
+void client_flush_titles(void) {
+    if (titles_pending == 0)
+        return;
+
+    double now = now_ms();
+    for (Client *c = client_first(); c; c = client_next(c)) {
+        if (c->title_pending && now - c->title_time >= CLIENT_TITLE_INTERVAL_MS)
+            client_update_title(c);
+    }
+}
+
+void client_dump_stats(void) {
+    LOG_INFO("Client title stats (%d clients):", client_manager.num_clients);
+    for (Client *c = client_first(); c; c = client_next(c)) {
+        if (c->title_changes == 0)
+            continue;
+        const char *title = client_title(c);
+        LOG_INFO("  0x%lx %-24.24s changes=%lu suppressed=%lu", c->window,
+                 title ? title : "", c->title_changes, c->titles_suppressed);
+    }
+}
+
+/* Track the urgency hint so the taskbar can highlight the client */
+void client_update_urgency(Client *client) {
+    bool urgent = props_is_urgent(&client->props, client->window);
+
+    if (urgent != client->is_urgent) {
+        client->is_urgent = urgent;
+        wm_events_publish(WM_EVENT_CLIENT_URGENT, client->window, urgent, NULL);
+    }
+}
+
+/*
+ * A throttled client gets no PropertyNotify selected on its window, so a
+ * property flood stops reaching the WM. Everything it changed meanwhile is
+ * reread once it is let go.
+ */
+void client_set_throttled(Client *client, bool throttled) {
+    if (client->throttled == throttled)
+        return;
+    client->throttled = throttled;
+    xerror_mark(client);
+    XSelectInput(wm.display, client->window,
+                 throttled ? CLIENT_WINDOW_EVENTS & ~PropertyChangeMask : CLIENT_WINDOW_EVENTS);
+    if (!throttled) {
+        client->props.valid = 0;
+        client_title_changed(client);
+        client_update_urgency(client);
+    }
+}
+
+/* Ask the client to close via WM_DELETE_WINDOW, or kill it if unsupported */
+void client_close(Client *client) {
+    xerror_mark(client);
+    if (props_has_protocol(&client->props, client->window, wm.atoms[WM_DELETE_WINDOW])) {
+        XEvent ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.xclient.type = ClientMessage;
+        ev.xclient.window = client->window;
+        ev.xclient.message_type = wm.atoms[WM_PROTOCOLS];
+        ev.xclient.format = 32;
+        ev.xclient.data.l[0] = wm.atoms[WM_DELETE_WINDOW];
+        ev.xclient.data.l[1] = CurrentTime;
+        XSendEvent(wm.display, client->window, False, NoEventMask, &ev);
+    } else {
+        XKillClient(wm.display, client->window);
+    }
+}
+
+/* Paint the frame border and titlebar using the configured colors */
+void client_draw_decorations(Client *client) {
+    bool focused = client == client_manager.focused;
+
+    xerror_mark(client);
+
+    XSetWindowBorder(wm.display, client->frame,
+                     focused ? config.window.focus_border_color : config.window.border_color);
+    XSetWindowBackground(wm.display, client->frame, config.window.titlebar_color);
+    XClearWindow(wm.display, client->frame);
+
+    if (client->title.size_class != CLIENT_TITLE_NONE && config.window.titlebar_height > 0) {
+        const char *title = client_title(client);
+        int length = client->title.length;
+        char hung[256];
+        if (client->not_responding) {
+            // Dimmed, so a hung app is told apart from a slow desktop
+            length = snprintf(hung, sizeof(hung), "%.200s (not responding)", title);
+            if (length >= (int)sizeof(hung))
+                length = sizeof(hung) - 1;
+            title = hung;
+        }
+        XSetForeground(wm.display, wm.gc, client->not_responding ?
+                       config.window.border_color : config.window.title_text_color);
+        XDrawString(wm.display, client->frame, wm.gc, 6,
+                    (config.window.titlebar_height + config.window.font_size) / 2,
+                    title, length);
+    }
+    client->needs_redraw = false;
+}
+
+/* Repaint every frame, e.g. after the decoration colors changed */
+void client_redraw_all(void) {
+    for (Client *c = client_first(); c; c = client_next(c)) {
+        client_draw_decorations(c);
+    }
+}
+
+/* Resize frames after the border width or titlebar height changed */
+void client_reframe_all(void) {
+    for (Client *c = client_first(); c; c = client_next(c)) {
+        if (client_is_fullscreen(c)) continue;
+        XSetWindowBorderWidth(wm.display, c->frame, config.window.border_width);
+        XResizeWindow(wm.display, c->frame, CLIENT_WIDTH(c),
+                      CLIENT_HEIGHT(c) + config.window.titlebar_height);
+        XMoveWindow(wm.display, c->window, 0, config.window.titlebar_height);
+        client_draw_decorations(c);
+    }
+}
+
+/* -- Keybinding actions -- */
+
+void client_focus_next(void) {
+    Client *focused = client_manager.focused;
+    Client *next = focused ? client_next(focused) : NULL;
+    if (!next) next = client_first();
+    if (next) client_focus(next);
+}
+
+void client_cycle_focus(void) {
+    client_focus_next();
+}
+
+void client_close_focused(void) {
+    if (client_manager.focused)
+        client_close(client_manager.focused);
+}
+
+/* Enter or leave fullscreen, and tell the client through _NET_WM_STATE */
+void client_set_fullscreen(Client *c, bool fullscreen) {
+    if (client_is_fullscreen(c) == fullscreen)
+        return;
+
+    if (fullscreen) {
+        c->saved_x = CLIENT_X(c);
+        c->saved_y = CLIENT_Y(c);
+        c->saved_width = CLIENT_WIDTH(c);
+        c->saved_height = CLIENT_HEIGHT(c);
+        client_set_flag(c, CLIENT_FLAG_FULLSCREEN, true);
+
+        XSetWindowBorderWidth(wm.display, c->frame, 0);
+        XMoveResizeWindow(wm.display, c->frame, 0, 0, wm.desktop_width, wm.desktop_height);
+        XMoveResizeWindow(wm.display, c->window, 0, 0, wm.desktop_width, wm.desktop_height);
+        XRaiseWindow(wm.display, c->frame);
+        ewmh_client_raised(c->window);
+        CLIENT_X(c) = 0;
+        CLIENT_Y(c) = 0;
+        CLIENT_WIDTH(c) = wm.desktop_width;
+        CLIENT_HEIGHT(c) = wm.desktop_height;
+    } else {
+        client_set_flag(c, CLIENT_FLAG_FULLSCREEN, false);
+        XSetWindowBorderWidth(wm.display, c->frame, config.window.border_width);
+        XMoveWindow(wm.display, c->window, 0, config.window.titlebar_height);
+        client_move(c, c->saved_x, c->saved_y);
+        client_resize(wm.display, c, c->saved_width, c->saved_height);
+    }
+    XChangeProperty(wm.display, c->window, wm.atoms[NET_WM_STATE], XA_ATOM, 32,
+                    PropModeReplace, (unsigned char *)&wm.atoms[NET_WM_STATE_FULLSCREEN],
+                    fullscreen ? 1 : 0);
+    cpu_policy_changed();    // A fullscreen client hides the others
+}
+
+void client_toggle_fullscreen_focused(void) {
+    Client *c = client_manager.focused;
+    if (c)
+        client_set_fullscreen(c, !client_is_fullscreen(c));
 }
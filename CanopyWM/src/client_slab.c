@@ -0,0 +1,256 @@
+// src/client_slab.c
+#include "client.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SLAB_CHUNK 64                  // Clients per chunk; chunks are never moved
+#define TITLE_PAGE_SIZE (64 * 1024)
+#define TITLE_CLASSES 6                // 64 bytes up to 2 KiB, doubling
+#define TITLE_MIN_BLOCK 64
+#define TITLE_MAX_BLOCK (TITLE_MIN_BLOCK << (TITLE_CLASSES - 1))
+
+ClientTable client_table;
+
+static struct {
+    Client **chunks;
+    uint32_t num_chunks;
+    uint32_t *free_slots;              // Stack of freed slots, reused first
+    uint32_t num_free;
+} slab;
+
+typedef struct TitlePage {
+    struct TitlePage *next;
+    size_t used;
+    char data[];
+} TitlePage;
+
+static struct {
+    TitlePage *pages;                  // Current page first
+    void *free_blocks[TITLE_CLASSES];  // Freed blocks, linked through their first bytes
+} titles;
+
+static Client *slot_client(uint32_t slot) {
+    return &slab.chunks[slot / SLAB_CHUNK][slot % SLAB_CHUNK];
+}
+
+#define GROW(field)                                                              \
+    do {                                                                         \
+        void *p = realloc(client_table.field, capacity * sizeof(*client_table.field)); \
+        if (!p) return false;                                                    \
+        client_table.field = p;                                                  \
+    } while (0)
+
+static bool grow(void) {
+    uint32_t capacity = client_table.capacity ? client_table.capacity * 2 : SLAB_CHUNK;
+    if (capacity > CLIENT_MAX + 1)
+        capacity = CLIENT_MAX + 1;
+    if (capacity <= client_table.capacity)
+        return false;
+
+    GROW(window);
+    GROW(frame);
+    GROW(x);
+    GROW(y);
+    GROW(width);
+    GROW(height);
+    GROW(flags);
+    GROW(generation);
+
+    uint32_t num_chunks = (capacity + SLAB_CHUNK - 1) / SLAB_CHUNK;
+    Client **chunks = realloc(slab.chunks, num_chunks * sizeof(*chunks));
+    if (!chunks) return false;
+    slab.chunks = chunks;
+    for (; slab.num_chunks < num_chunks; slab.num_chunks++) {
+        slab.chunks[slab.num_chunks] = calloc(SLAB_CHUNK, sizeof(Client));
+        if (!slab.chunks[slab.num_chunks]) return false;
+    }
+
+    uint32_t *free_slots = realloc(slab.free_slots, capacity * sizeof(*free_slots));
+    if (!free_slots) return false;
+    slab.free_slots = free_slots;
+
+    client_table.capacity = capacity;
+    return true;
+}
+
+Client *client_slot_alloc(Window window, Window frame) {
+    uint32_t slot;
+    if (slab.num_free > 0) {
+        slot = slab.free_slots[--slab.num_free];
+    } else {
+        if (client_table.used == client_table.capacity && !grow())
+            return NULL;
+        slot = client_table.used++;
+        client_table.generation[slot] = 1;
+    }
+
+    client_table.window[slot] = window;
+    client_table.frame[slot] = frame;
+    client_table.x[slot] = 0;
+    client_table.y[slot] = 0;
+    client_table.width[slot] = 0;
+    client_table.height[slot] = 0;
+    client_table.flags[slot] = CLIENT_FLAG_LIVE;
+
+    Client *c = slot_client(slot);
+    memset(c, 0, sizeof(*c));
+    c->slot = slot;
+    c->window = window;
+    c->frame = frame;
+    return c;
+}
+
+void client_slot_free(Client *client) {
+    uint32_t slot = client->slot;
+    client_title_clear(&client->title);
+    client_table.flags[slot] = 0;
+    client_table.window[slot] = None;
+    client_table.frame[slot] = None;
+    if (++client_table.generation[slot] == 0)
+        client_table.generation[slot] = 1;
+    slab.free_slots[slab.num_free++] = slot;
+}
+
+ClientHandle client_handle(const Client *client) {
+    return (ClientHandle)client_table.generation[client->slot] << 16 | client->slot;
+}
+
+Client *client_from_handle(ClientHandle handle) {
+    uint32_t slot = handle & 0xffff;
+    if (handle == CLIENT_HANDLE_NONE || slot >= client_table.used ||
+        client_table.generation[slot] != handle >> 16 ||
+        !(client_table.flags[slot] & CLIENT_FLAG_LIVE))
+        return NULL;
+    return slot_client(slot);
+}
+
+static Client *first_live(uint32_t slot) {
+    for (; slot < client_table.used; slot++) {
+        if (client_table.flags[slot] & CLIENT_FLAG_LIVE)
+            return slot_client(slot);
+    }
+    return NULL;
+}
+
+Client *client_first(void) {
+    return first_live(0);
+}
+
+Client *client_next(const Client *client) {
+    return first_live(client->slot + 1);
+}
+
+/* Match a client or frame window; a linear scan of two contiguous arrays */
+Client *client_slot_find(Window window) {
+    if (window == None)
+        return NULL;
+    for (uint32_t slot = 0; slot < client_table.used; slot++) {
+        if (client_table.window[slot] == window || client_table.frame[slot] == window)
+            return slot_client(slot);
+    }
+    return NULL;
+}
+
+void client_slab_cleanup(void) {
+    for (uint32_t i = 0; i < slab.num_chunks; i++)
+        free(slab.chunks[i]);
+    free(slab.chunks);
+    free(slab.free_slots);
+    memset(&slab, 0, sizeof(slab));
+
+    free(client_table.window);
+    free(client_table.frame);
+    free(client_table.x);
+    free(client_table.y);
+    free(client_table.width);
+    free(client_table.height);
+    free(client_table.flags);
+    free(client_table.generation);
+    memset(&client_table, 0, sizeof(client_table));
+
+    while (titles.pages) {
+        TitlePage *next = titles.pages->next;
+        free(titles.pages);
+        titles.pages = next;
+    }
+    memset(&titles, 0, sizeof(titles));
+}
+
+/* -- Title arena -- */
+
+static int title_class(size_t size) {
+    int cls = 0;
+    while ((size_t)(TITLE_MIN_BLOCK << cls) < size)
+        cls++;
+    return cls;
+}
+
+static char *title_block(int cls) {
+    size_t size = (size_t)TITLE_MIN_BLOCK << cls;
+    if (titles.free_blocks[cls]) {
+        void *block = titles.free_blocks[cls];
+        memcpy(&titles.free_blocks[cls], block, sizeof(void *));
+        return block;
+    }
+    if (!titles.pages || titles.pages->used + size > TITLE_PAGE_SIZE) {
+        TitlePage *page = malloc(sizeof(TitlePage) + TITLE_PAGE_SIZE);
+        if (!page) return NULL;
+        page->next = titles.pages;
+        page->used = 0;
+        titles.pages = page;
+    }
+    char *block = titles.pages->data + titles.pages->used;
+    titles.pages->used += size;
+    return block;
+}
+
+void client_title_clear(ClientTitle *title) {
+    if (title->size_class > CLIENT_TITLE_INLINE_CLASS) {
+        int cls = title->size_class - CLIENT_TITLE_INLINE_CLASS - 1;
+        memcpy(title->arena_str, &titles.free_blocks[cls], sizeof(void *));
+        titles.free_blocks[cls] = title->arena_str;
+    }
+    memset(title, 0, sizeof(*title));
+}
+
+/* NULL clears the title; longer titles than the largest block are cut */
+void client_title_set(ClientTitle *title, const char *str) {
+    if (!str) {
+        client_title_clear(title);
+        return;
+    }
+
+    size_t length = strlen(str);
+    if (length >= TITLE_MAX_BLOCK) {
+        length = TITLE_MAX_BLOCK - 1;
+        while (length > 0 && ((unsigned char)str[length] & 0xc0) == 0x80)
+            length--;
+    }
+
+    if (length < CLIENT_TITLE_INLINE) {
+        client_title_clear(title);
+        title->size_class = CLIENT_TITLE_INLINE_CLASS;
+        memcpy(title->inline_str, str, length);
+        title->inline_str[length] = '\0';
+    } else {
+        int cls = title_class(length + 1);
+        if (title->size_class != CLIENT_TITLE_INLINE_CLASS + 1 + cls) {
+            char *block = title_block(cls);
+            if (!block) return;
+            client_title_clear(title);
+            title->size_class = CLIENT_TITLE_INLINE_CLASS + 1 + cls;
+            title->arena_str = block;
+        }
+        memcpy(title->arena_str, str, length);
+        title->arena_str[length] = '\0';
+    }
+    title->length = length;
+}
+
+const char *client_title(const Client *client) {
+    switch (client->title.size_class) {
+    case CLIENT_TITLE_NONE: return NULL;
+    case CLIENT_TITLE_INLINE_CLASS: return client->title.inline_str;
+    default: return client->title.arena_str;
+    }
+}
@@ -1,46 +1,475 @@
-
 // config.c
 #include "config.h"
+#include "ini.h"
+#include "config_keys.h"
+#include "event_loop.h"
+#include "wm.h"
+#include "worker_pool.h"
+#include "log.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
 
 Config config;
 
-void config_init(void) {
+static char config_path[PATH_MAX];
+static int inotify_fd = -1;
+static int config_dir_wd = -1;      // Watch on the config directory
+static int parent_dir_wd = -1;      // Watch on its parent while the directory is missing
+static unsigned int config_generation;  // Bumped by every reload that replaces config
+static bool reload_running;         // A reload job is parsing the file
+static bool reload_again;           // The file changed again while it was
+
+typedef struct {
+    unsigned int generation;        // config_generation when the job was queued
+    bool parsed;
+    Config loaded;
+} ConfigReloadJob;
+
+static const KeybindConfig default_keybinds[] = {
+    { NULL, "focus_next",  "Alt+F11" },
+    { NULL, "cycle_focus", "Alt+Tab" },
+    { NULL, "close",       "Alt+Shift+q" },
+    { NULL, "fullscreen",  "Alt+f" },
+};
+
+static void config_set_defaults(Config *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+
     // Window defaults
-    config.window.border_width = 2;
-    config.window.border_color = 0x333333;
-    config.window.focus_border_color = 0x007acc;
-    config.window.titlebar_height = 24;
-    config.window.titlebar_color = 0x202020;
-    config.window.title_text_color = 0xffffff;
-    config.window.button_color = 0x404040;
-    config.window.button_text_color = 0xffffff;
-    config.window.font_size = 12;
+    cfg->window.border_width = 2;
+    cfg->window.border_color = 0x333333;
+    cfg->window.focus_border_color = 0x007acc;
+    cfg->window.titlebar_height = 24;
+    cfg->window.titlebar_color = 0x202020;
+    cfg->window.title_text_color = 0xffffff;
+    cfg->window.button_color = 0x404040;
+    cfg->window.button_text_color = 0xffffff;
+    cfg->window.font_size = 12;
 
     // Layout defaults
-    config.layout.master_size = 600;
-    config.layout.master_count = 1;
-    config.layout.split_ratio = 0.6f;
-    config.layout.snap_distance = 10;
+    cfg->layout.master_size = 600;
+    cfg->layout.master_count = 1;
+    cfg->layout.split_ratio = 0.6f;
+    cfg->layout.snap_distance = 10;
 
     // Appearance defaults
-    config.appearance.wallpaper_path = strdup("default_wallpaper.jpg");
-    config.appearance.wallpaper_mode = WALLPAPER_STRETCH;
-    config.appearance.background_color = 0xcccccc;
+    cfg->appearance.wallpaper_path = strdup("default_wallpaper.jpg");
+    cfg->appearance.wallpaper_mode = WALLPAPER_STRETCH;
+    cfg->appearance.background_color = 0xcccccc;
 
     // System defaults
-    config.system.volume_step = 5;
-    config.system.brightness_step = 5;
+    cfg->system.volume_step = 5;
+    cfg->system.brightness_step = 5;
+    cfg->system.cpu_weight_focused = 200;
+    cfg->system.cpu_weight_background = 25;
+
+    // Keybinding defaults
+    for (size_t i = 0; i < sizeof(default_keybinds) / sizeof(default_keybinds[0]); i++) {
+        cfg->keybinds.binds[i].mode = NULL;
+        cfg->keybinds.binds[i].action = strdup(default_keybinds[i].action);
+        cfg->keybinds.binds[i].keys = strdup(default_keybinds[i].keys);
+        cfg->keybinds.count++;
+    }
+}
+
+static void config_free(Config *cfg) {
+    free(cfg->appearance.wallpaper_path);
+    cfg->appearance.wallpaper_path = NULL;
+    for (int i = 0; i < cfg->keybinds.count; i++) {
+        free(cfg->keybinds.binds[i].mode);
+        free(cfg->keybinds.binds[i].action);
+        free(cfg->keybinds.binds[i].keys);
+    }
+    cfg->keybinds.count = 0;
+}
+
+static bool str_eq_view(const char *s, IniStr view) {
+    if (!s) return view.len == 0;
+    return strlen(s) == view.len && memcmp(s, view.ptr, view.len) == 0;
+}
+
+/*
+ * Bind (or rebind) an action within a mode, replacing its default key
+ * sequence. An empty mode is the default mode.
+ */
+static void config_set_keybind(Config *cfg, IniStr mode, IniStr action, IniStr keys) {
+    for (int i = 0; i < cfg->keybinds.count; i++) {
+        KeybindConfig *bind = &cfg->keybinds.binds[i];
+        if (str_eq_view(bind->mode, mode) && str_eq_view(bind->action, action)) {
+            free(bind->keys);
+            bind->keys = strndup(keys.ptr, keys.len);
+            return;
+        }
+    }
+    if (cfg->keybinds.count >= CONFIG_MAX_KEYBINDS) {
+        LOG_WARN("Too many keybindings, ignoring '%.*s'.", (int)action.len, action.ptr);
+        return;
+    }
+    KeybindConfig *bind = &cfg->keybinds.binds[cfg->keybinds.count++];
+    bind->mode = mode.len ? strndup(mode.ptr, mode.len) : NULL;
+    bind->action = strndup(action.ptr, action.len);
+    bind->keys = strndup(keys.ptr, keys.len);
+}
+
+static WallpaperMode parse_wallpaper_mode(IniStr value) {
+    if (ini_str_eq(value, "center")) return WALLPAPER_CENTER;
+    if (ini_str_eq(value, "tile")) return WALLPAPER_TILE;
+    return WALLPAPER_STRETCH;
+}
+
+/* Decimal or 0x-prefixed hexadecimal, parsed in place */
+static unsigned int parse_uint(IniStr value) {
+    const char *p = value.ptr;
+    const char *end = value.ptr + value.len;
+    unsigned int base = 10;
+    unsigned int result = 0;
+
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        base = 16;
+        p += 2;
+    }
+    for (; p < end; p++) {
+        unsigned int digit;
+        if (*p >= '0' && *p <= '9') digit = *p - '0';
+        else if (base == 16 && *p >= 'a' && *p <= 'f') digit = *p - 'a' + 10;
+        else if (base == 16 && *p >= 'A' && *p <= 'F') digit = *p - 'A' + 10;
+        else break;
+        result = result * base + digit;
+    }
+    return result;
+}
+
+static float parse_float(IniStr value) {
+    char buf[32];
+    size_t len = value.len < sizeof(buf) - 1 ? value.len : sizeof(buf) - 1;
+    memcpy(buf, value.ptr, len);
+    buf[len] = '\0';
+    return strtof(buf, NULL);
+}
+
+/*
+ * Store a value straight into its Config field: known options are resolved
+ * through the generated perfect-hash table (config_keys.def), so there is no
+ * per-option string comparison chain.
+ */
+int config_ini_handler(void *user, IniStr section, IniStr name, IniStr value) {
+    Config *cfg = user;
+
+    // [keybinds] holds the default mode, [keybinds.<mode>] any other mode
+    if (section.len >= 8 && memcmp(section.ptr, "keybinds", 8) == 0 &&
+        (section.len == 8 || section.ptr[8] == '.')) {
+        IniStr mode = { section.ptr + 9, section.len > 9 ? section.len - 9 : 0 };
+        config_set_keybind(cfg, mode, name, value);
+        return 1;
+    }
+
+    const ConfigKey *key = config_key_lookup(section, name);
+    if (!key) {
+        LOG_WARN("Unknown config option [%.*s] %.*s",
+                 (int)section.len, section.ptr, (int)name.len, name.ptr);
+        return 1;
+    }
+
+    char *field = (char *)cfg + key->offset;
+    switch (key->type) {
+        case CONFIG_KEY_UINT:
+            *(unsigned int *)field = parse_uint(value);
+            break;
+        case CONFIG_KEY_FLOAT:
+            *(float *)field = parse_float(value);
+            break;
+        case CONFIG_KEY_STRING:
+            free(*(char **)field);
+            *(char **)field = strndup(value.ptr, value.len);
+            break;
+        case CONFIG_KEY_WALLPAPER_MODE:
+            *(WallpaperMode *)field = parse_wallpaper_mode(value);
+            break;
+    }
+    return 1;
+}
+
+static bool streq(const char *a, const char *b) {
+    if (!a || !b) return a == b;
+    return strcmp(a, b) == 0;
+}
+
+/* Report which parts of the configuration differ, as CONFIG_CHANGED_* bits */
+unsigned int config_diff(const Config *a, const Config *b) {
+    unsigned int changed = 0;
+
+    if (a->window.border_color != b->window.border_color ||
+        a->window.focus_border_color != b->window.focus_border_color ||
+        a->window.titlebar_color != b->window.titlebar_color ||
+        a->window.title_text_color != b->window.title_text_color ||
+        a->window.button_color != b->window.button_color ||
+        a->window.button_text_color != b->window.button_text_color ||
+        a->window.font_size != b->window.font_size)
+        changed |= CONFIG_CHANGED_DECORATION;
+
+    if (a->window.border_width != b->window.border_width ||
+        a->window.titlebar_height != b->window.titlebar_height)
+        changed |= CONFIG_CHANGED_FRAME;
+
+    // [layout] is parsed but nothing tiles yet, so it needs no reapplying.
+
+    if (!streq(a->appearance.wallpaper_path, b->appearance.wallpaper_path) ||
+        a->appearance.wallpaper_mode != b->appearance.wallpaper_mode ||
+        a->appearance.background_color != b->appearance.background_color)
+        changed |= CONFIG_CHANGED_APPEARANCE;
+
+    if (memcmp(&a->system, &b->system, sizeof(a->system)) != 0)
+        changed |= CONFIG_CHANGED_SYSTEM;
+
+    if (a->keybinds.count != b->keybinds.count) {
+        changed |= CONFIG_CHANGED_KEYBINDS;
+    } else {
+        for (int i = 0; i < a->keybinds.count; i++) {
+            if (!streq(a->keybinds.binds[i].mode, b->keybinds.binds[i].mode) ||
+                !streq(a->keybinds.binds[i].action, b->keybinds.binds[i].action) ||
+                !streq(a->keybinds.binds[i].keys, b->keybinds.binds[i].keys)) {
+                changed |= CONFIG_CHANGED_KEYBINDS;
+                break;
+            }
+        }
+    }
+
+    return changed;
+}
+
+static void config_find_path(void) {
+    const char *xdg = getenv("XDG_CONFIG_HOME");
+    const char *home = getenv("HOME");
+
+    if (xdg && xdg[0] == '/')
+        snprintf(config_path, sizeof(config_path), "%s/canopy/rc", xdg);
+    else if (home)
+        snprintf(config_path, sizeof(config_path), "%s/.config/canopy/rc", home);
+    else
+        config_path[0] = '\0';
+}
+
+const char *config_get_path(void) {
+    return config_path;
+}
+
+/* Copy the directory holding the config file into dir */
+static bool config_dir(char *dir, size_t len) {
+    snprintf(dir, len, "%s", config_path);
+    char *slash = strrchr(dir, '/');
+    if (!slash) return false;
+    *slash = '\0';
+    return true;
+}
+
+/*
+ * Watch the directory rather than the file itself: most editors save by
+ * writing a new file and renaming it over the old one. If the directory
+ * does not exist yet, watch its parent until it is created.
+ */
+static bool config_add_watch(void) {
+    char dir[PATH_MAX];
+    if (!config_dir(dir, sizeof(dir)))
+        return false;
+
+    config_dir_wd = inotify_add_watch(inotify_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (config_dir_wd >= 0)
+        return true;
+    if (errno != ENOENT) {
+        LOG_WARN("Cannot watch %s, config hot-reload disabled: %s", dir, strerror(errno));
+        return false;
+    }
+
+    char *slash = strrchr(dir, '/');
+    if (slash && slash != dir) {
+        *slash = '\0';
+        parent_dir_wd = inotify_add_watch(inotify_fd, dir,
+                                          IN_CREATE | IN_MOVED_TO | IN_ONLYDIR);
+    }
+    if (parent_dir_wd < 0) {
+        LOG_WARN("Config directory for %s is missing and cannot be watched, "
+                 "config hot-reload disabled", config_path);
+        return false;
+    }
+    LOG_INFO("Config directory for %s does not exist yet, waiting for it", config_path);
+    return true;
+}
+
+static void config_reload_async(void);
+
+/* Reload the config file once an editor has finished writing it */
+static void config_handle_inotify(int fd, void *data) {
+    (void)data;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char dir[PATH_MAX];
+    const char *basename = strrchr(config_path, '/') + 1;
+    const char *dirname = NULL;
+    bool touched = false;
+    ssize_t len;
+
+    if (parent_dir_wd >= 0 && config_dir(dir, sizeof(dir)))
+        dirname = strrchr(dir, '/') + 1;
+
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; ) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            if (ev->len > 0 && ev->wd == config_dir_wd && strcmp(ev->name, basename) == 0)
+                touched = true;
+            if (ev->len > 0 && ev->wd == parent_dir_wd && dirname &&
+                (ev->mask & IN_ISDIR) && strcmp(ev->name, dirname) == 0) {
+                inotify_rm_watch(fd, parent_dir_wd);
+                parent_dir_wd = -1;
+                dirname = NULL;
+                if (config_add_watch() && config_dir_wd >= 0)
+                    touched = access(config_path, R_OK) == 0;
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+
+    if (touched)
+        config_reload_async();
+}
+
+static void config_watch(void) {
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        LOG_WARN("inotify unavailable, config hot-reload disabled: %s", strerror(errno));
+        return;
+    }
+    if (!config_add_watch()) {
+        close(inotify_fd);
+        inotify_fd = -1;
+        return;
+    }
+    event_loop_add_fd(inotify_fd, config_handle_inotify, NULL);
+}
+
+void config_init(void) {
+    config_set_defaults(&config);
+
+    config_find_path();
+    if (config_path[0] == '\0')
+        return;
+
+    if (access(config_path, R_OK) == 0)
+        config_load(config_path);
+    config_watch();
 }
 
 void config_cleanup(void) {
-    free(config.appearance.wallpaper_path);
-    config.appearance.wallpaper_path = NULL;
+    if (inotify_fd >= 0) {
+        event_loop_remove_fd(inotify_fd);
+        close(inotify_fd);
+        inotify_fd = -1;
+        config_dir_wd = parent_dir_wd = -1;
+    }
+    config_free(&config);
 }
 
 bool config_load(const char *path) {
-    // Implementation would go here
-    (void)path; // Temporary unused parameter
+    Config loaded;
+    config_set_defaults(&loaded);
+
+    if (ini_parse_view(path, config_ini_handler, &loaded) < 0) {
+        LOG_WARN("Cannot read config file %s", path);
+        config_free(&loaded);
+        return false;
+    }
+
+    config_free(&config);
+    config = loaded;
+    LOG_INFO("Loaded config from %s", path);
+    return true;
+}
+
+/* Parse the config file into cfg; touches no global state */
+static bool config_parse(Config *cfg) {
+    config_set_defaults(cfg);
+    if (ini_parse_view(config_path, config_ini_handler, cfg) < 0) {
+        config_free(cfg);
+        return false;
+    }
     return true;
 }
+
+/* Replace the running configuration with a parsed one */
+static unsigned int config_replace(Config *loaded) {
+    unsigned int changed = config_diff(&config, loaded);
+    config_free(&config);
+    config = *loaded;
+    config_generation++;
+    LOG_INFO("Reloaded config from %s (changed sections: 0x%x)", config_path, changed);
+    return changed;
+}
+
+/*
+ * Re-read the config file and return the CONFIG_CHANGED_* sections that
+ * differ from the running configuration, so callers only reapply those.
+ */
+unsigned int config_reload(void) {
+    Config loaded;
+    if (!config_parse(&loaded)) {
+        LOG_WARN("Cannot read config file %s, keeping current settings", config_path);
+        return 0;
+    }
+    return config_replace(&loaded);
+}
+
+static void *parse_config_job(void *data) {
+    ConfigReloadJob *job = data;
+    job->parsed = config_parse(&job->loaded);
+    return job;
+}
+
+/* Apply a parsed config, unless a newer reload got there first */
+static void publish_config_job(void *result) {
+    ConfigReloadJob *job = result;
+    reload_running = false;
+
+    if (!job->parsed) {
+        LOG_WARN("Cannot read config file %s, keeping current settings", config_path);
+    } else if (job->generation != config_generation) {
+        config_free(&job->loaded);
+    } else {
+        unsigned int changed = config_replace(&job->loaded);
+        if (changed)
+            wm_apply_config(changed);
+    }
+    free(job);
+
+    if (reload_again) {
+        reload_again = false;
+        config_reload_async();
+    }
+}
+
+/*
+ * Reload for the inotify watch: the file is read and parsed on a worker so
+ * a slow filesystem cannot stall the event loop, then applied on the main
+ * thread. Changes that arrive meanwhile queue one more reload.
+ */
+static void config_reload_async(void) {
+    if (reload_running) {
+        reload_again = true;
+        return;
+    }
+
+    ConfigReloadJob *job = calloc(1, sizeof(*job));
+    if (job) {
+        job->generation = config_generation;
+        reload_running = true;
+        if (worker_pool_submit("config_reload", parse_config_job, publish_config_job, job))
+            return;
+        reload_running = false;
+        free(job);
+    }
+    unsigned int changed = config_reload();     // No memory for the job
+    if (changed)
+        wm_apply_config(changed);
+}
@@ -0,0 +1,18 @@
+// src/config_keys.c
+#include "config_keys.h"
+#include "config.h"
+#include "config_key_table.h"   // Generated by tools/gen_config_keys.c
+#include <string.h>
+
+const ConfigKey *config_key_lookup(IniStr section, IniStr name) {
+    uint32_t slot = config_key_hash(CONFIG_KEY_SEED, section, name) & (CONFIG_KEY_SLOTS - 1);
+    const ConfigKey *key = &config_key_table[slot];
+
+    if (key->name &&
+        key->section_len == section.len && key->name_len == name.len &&
+        memcmp(key->section, section.ptr, section.len) == 0 &&
+        memcmp(key->name, name.ptr, name.len) == 0) {
+        return key;
+    }
+    return NULL;
+}
@@ -0,0 +1,297 @@
+// src/cpu_policy.c
+#include "cpu_policy.h"
+#include "client.h"
+#include "config.h"
+#include "event_loop.h"
+#include "log.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SYSTEMD_DEST "org.freedesktop.systemd1"
+#define SYSTEMD_PATH "/org/freedesktop/systemd1"
+#define SYSTEMD_MANAGER "org.freedesktop.systemd1.Manager"
+
+enum { RANK_HIDDEN, RANK_VISIBLE, RANK_FOCUSED };
+
+typedef struct {
+    pid_t pid;
+    int rank;                          // Highest RANK_* among its windows, -1 for none
+    unsigned int wanted;
+    unsigned int applied;              // In effect; CPU_WEIGHT_DEFAULT before the scope exists
+    unsigned int sending;              // Weight of the call in flight
+    bool scoped;
+    bool in_flight;
+    bool failed;                       // No scope could be made; left alone from then on
+} CpuApp;
+
+static struct {
+    sd_bus *bus;
+    char host[256];                    // Local hostname; _NET_WM_PID means nothing elsewhere
+    CpuApp apps[CPU_POLICY_MAX_APPS];
+    int num_apps;
+    bool dirty;                        // Changes waiting for the debounce
+    bool unapplied;                    // Some app's wanted weight is not in effect
+    double first_change;
+    double last_change;
+
+    unsigned long changes;
+    unsigned long evaluations;
+    unsigned long calls;
+    unsigned long failures;
+} policy;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static unsigned int weight_or_default(unsigned int weight) {
+    return weight ? weight : CPU_WEIGHT_DEFAULT;
+}
+
+static unsigned int rank_weight(int rank) {
+    switch (rank) {
+    case RANK_FOCUSED: return weight_or_default(config.system.cpu_weight_focused);
+    case RANK_HIDDEN: return weight_or_default(config.system.cpu_weight_background);
+    default: return CPU_WEIGHT_DEFAULT;
+    }
+}
+
+/*
+ * Whether nothing of the client can be seen. There are no workspaces or
+ * minimized windows yet; a focused fullscreen client covers all others.
+ */
+static bool client_hidden(const Client *c) {
+    const Client *focused = client_manager.focused;
+    return focused && focused != c && client_is_fullscreen(focused);
+}
+
+static CpuApp *find_app(pid_t pid) {
+    for (int i = 0; i < policy.num_apps; i++) {
+        if (policy.apps[i].pid == pid)
+            return &policy.apps[i];
+    }
+    return NULL;
+}
+
+static CpuApp *add_app(pid_t pid) {
+    if (policy.num_apps == CPU_POLICY_MAX_APPS)
+        return NULL;
+    CpuApp *app = &policy.apps[policy.num_apps++];
+    memset(app, 0, sizeof(*app));
+    app->pid = pid;
+    app->applied = CPU_WEIGHT_DEFAULT;
+    return app;
+}
+
+static void unit_name(pid_t pid, char *buf, size_t size) {
+    snprintf(buf, size, "app-canopy-%d.scope", (int)pid);
+}
+
+static int on_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+    (void)ret_error;
+    CpuApp *app = find_app((pid_t)(intptr_t)userdata);
+    if (!app)
+        return 0;
+    app->in_flight = false;
+    policy.unapplied = true;           // The wanted weight may have moved meanwhile
+
+    if (!sd_bus_message_is_method_error(m, NULL)) {
+        app->scoped = true;
+        app->applied = app->sending;
+        return 0;
+    }
+
+    const sd_bus_error *error = sd_bus_message_get_error(m);
+    if (!app->scoped && sd_bus_error_has_name(error, "org.freedesktop.systemd1.UnitExists")) {
+        // Made before a restart of the WM; set its weight next time
+        app->scoped = true;
+        app->applied = 0;
+        return 0;
+    }
+    policy.failures++;
+    app->failed = true;
+    LOG_WARN("Cannot set the CPU weight of pid %d: %s", (int)app->pid,
+             error && error->message ? error->message : "unknown error");
+    return 0;
+}
+
+static void send_weight(CpuApp *app) {
+    char unit[64];
+    unit_name(app->pid, unit, sizeof(unit));
+    uint64_t weight = app->wanted;
+    void *userdata = (void *)(intptr_t)app->pid;
+    int ret;
+
+    if (app->scoped) {
+        ret = sd_bus_call_method_async(policy.bus, NULL, SYSTEMD_DEST, SYSTEMD_PATH,
+                                       SYSTEMD_MANAGER, "SetUnitProperties", on_reply, userdata,
+                                       "sba(sv)", unit, 1, 1, "CPUWeight", "t", weight);
+    } else {
+        ret = sd_bus_call_method_async(policy.bus, NULL, SYSTEMD_DEST, SYSTEMD_PATH,
+                                       SYSTEMD_MANAGER, "StartTransientUnit", on_reply, userdata,
+                                       "ssa(sv)a(sa(sv))", unit, "fail", 3,
+                                       "PIDs", "au", 1, (uint32_t)app->pid,
+                                       "CPUWeight", "t", weight,
+                                       "CollectMode", "s", "inactive-or-failed",
+                                       0);
+    }
+    if (ret < 0) {
+        LOG_WARN("Cannot queue the CPU weight of pid %d: %s", (int)app->pid, strerror(-ret));
+        policy.failures++;
+        app->failed = true;
+        return;
+    }
+    app->in_flight = true;
+    app->sending = app->wanted;
+    policy.calls++;
+}
+
+/* Work out every application's weight from the current clients */
+static void evaluate(void) {
+    policy.evaluations++;
+    for (int i = 0; i < policy.num_apps; i++)
+        policy.apps[i].rank = -1;
+
+    for (Client *c = client_first(); c; c = client_next(c)) {
+        pid_t pid = props_pid(&c->props, c->window);
+        if (pid <= 0 || !props_machine_is(&c->props, c->window, policy.host))
+            continue;
+        CpuApp *app = find_app(pid);
+        if (!app && !(app = add_app(pid)))
+            continue;
+        int rank = c == client_manager.focused ? RANK_FOCUSED :
+                   client_hidden(c) ? RANK_HIDDEN : RANK_VISIBLE;
+        if (rank > app->rank)
+            app->rank = rank;
+    }
+
+    // Forget processes that are gone; the scope goes away with them
+    int kept = 0;
+    for (int i = 0; i < policy.num_apps; i++) {
+        CpuApp *app = &policy.apps[i];
+        if (!app->in_flight && kill(app->pid, 0) < 0 && errno == ESRCH)
+            continue;
+        app->wanted = app->rank < 0 ? CPU_WEIGHT_DEFAULT : rank_weight(app->rank);
+        policy.apps[kept++] = *app;
+    }
+    policy.num_apps = kept;
+    policy.unapplied = true;
+}
+
+static void apply(void) {
+    policy.unapplied = false;
+    for (int i = 0; i < policy.num_apps; i++) {
+        CpuApp *app = &policy.apps[i];
+        if (app->failed || app->wanted == app->applied)
+            continue;
+        if (app->in_flight) {
+            policy.unapplied = true;   // Retried once the reply is in
+            continue;
+        }
+        if (!app->scoped && app->wanted == CPU_WEIGHT_DEFAULT) {
+            app->applied = CPU_WEIGHT_DEFAULT;     // Nothing to undo without a scope
+            continue;
+        }
+        send_weight(app);
+    }
+}
+
+static void process_bus(int fd, void *data) {
+    (void)fd;
+    (void)data;
+    while (sd_bus_process(policy.bus, NULL) > 0)
+        ;
+}
+
+sd_bus *cpu_policy_connect(void) {
+    sd_bus *bus = NULL;
+    int ret = sd_bus_open_user(&bus);
+    if (ret < 0) {
+        LOG_WARN("Cannot connect to the user bus, CPU weights stay unmanaged: %s",
+                 strerror(-ret));
+        return NULL;
+    }
+    return bus;
+}
+
+void cpu_policy_publish(sd_bus *bus) {
+    if (!bus)
+        return;
+    if (gethostname(policy.host, sizeof(policy.host) - 1) < 0) {
+        LOG_WARN("Cannot get the hostname, CPU weights stay unmanaged: %s", strerror(errno));
+        sd_bus_flush_close_unref(bus);
+        return;
+    }
+    policy.bus = bus;
+    event_loop_add_fd(sd_bus_get_fd(bus), process_bus, NULL);
+    cpu_policy_changed();
+}
+
+/*
+ * The scopes outlive the WM, so put them back to the default weight. A scope
+ * still being made gets the call too; the manager handles it after the
+ * StartTransientUnit queued before it.
+ */
+void cpu_policy_cleanup(void) {
+    if (!policy.bus)
+        return;
+    for (int i = 0; i < policy.num_apps; i++) {
+        CpuApp *app = &policy.apps[i];
+        if (!app->scoped && !app->in_flight)
+            continue;
+        char unit[64];
+        unit_name(app->pid, unit, sizeof(unit));
+        sd_bus_call_method_async(policy.bus, NULL, SYSTEMD_DEST, SYSTEMD_PATH, SYSTEMD_MANAGER,
+                                 "SetUnitProperties", NULL, NULL, "sba(sv)", unit, 1, 1,
+                                 "CPUWeight", "t", (uint64_t)CPU_WEIGHT_DEFAULT);
+    }
+    policy.num_apps = 0;
+    event_loop_remove_fd(sd_bus_get_fd(policy.bus));
+    sd_bus_flush_close_unref(policy.bus);
+    policy.bus = NULL;
+}
+
+void cpu_policy_changed(void) {
+    double now = now_ms();
+    if (!policy.dirty)
+        policy.first_change = now;
+    policy.dirty = true;
+    policy.last_change = now;
+    policy.changes++;
+}
+
+void cpu_policy_flush(void) {
+    if (!policy.bus)
+        return;
+
+    if (policy.dirty) {
+        double now = now_ms();
+        if (now - policy.last_change >= CPU_POLICY_DEBOUNCE_MS ||
+            now - policy.first_change >= CPU_POLICY_MAX_DELAY_MS) {
+            policy.dirty = false;
+            evaluate();
+        }
+    }
+    if (policy.unapplied)
+        apply();
+    // Sends what apply() queued and handles replies and timeouts
+    process_bus(-1, NULL);
+}
+
+void cpu_policy_dump_stats(void) {
+    LOG_INFO("CPU policy: %s, %lu changes, %lu evaluations, %lu calls, %lu failures",
+             policy.bus ? "active" : "off", policy.changes, policy.evaluations,
+             policy.calls, policy.failures);
+    for (int i = 0; i < policy.num_apps; i++) {
+        const CpuApp *app = &policy.apps[i];
+        LOG_INFO("  pid %-7d weight %u%s%s", (int)app->pid, app->applied,
+                 app->scoped ? "" : " (no scope)", app->failed ? " (failed)" : "");
+    }
+}
@@ -0,0 +1,245 @@
+// src/de_supervisor.c
+#include "de_supervisor.h"
+#include "event_loop.h"
+#include "notifications.h"
+#include "wm_events.h"
+#include "trace.h"
+#include "log.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+// Sender name for the supervisor's own notifications (rate-limit bucket)
+#define DE_NOTIFICATION_SENDER "Desktop supervisor"
+
+static struct {
+    const char *path;
+    DeSessionEndFunc on_session_end;
+    pid_t pid;
+    int pidfd;                  // Readable once the DE has exited
+    int timer_fd;               // Fires when a pending restart is due
+    bool restart_pending;
+    bool awaiting_ready;
+    struct timespec spawn_time;
+    int starts;
+    int consecutive_crashes;    // Drives the backoff
+    double crash_times[DE_CRASH_LOOP_LIMIT];  // Ring of recent crash times
+    int num_crashes;
+} sup = { .pid = -1, .pidfd = -1, .timer_fd = -1 };
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double seconds_since(const struct timespec *ts) {
+    return now_seconds() - (ts->tv_sec + ts->tv_nsec / 1e9);
+}
+
+static void handle_exit(int fd, void *data);
+
+static bool watch(pid_t pid) {
+    sup.pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (sup.pidfd < 0 || !event_loop_add_fd(sup.pidfd, handle_exit, NULL)) {
+        LOG_WARN("Cannot watch desktop environment %d (%s); its exit will go unnoticed.",
+                 pid, strerror(errno));
+        if (sup.pidfd >= 0) close(sup.pidfd);
+        sup.pidfd = -1;
+        return false;
+    }
+    return true;
+}
+
+static bool spawn(void) {
+    LOG_INFO("Starting desktop environment: %s", sup.path);
+    wm_events_reset();
+    pid_t pid = fork();
+    if (pid == 0) {
+        wm_events_set_inheritable(true);
+        execl(sup.path, sup.path, NULL);
+        LOG_ERROR("Failed to start desktop environment (%s).", sup.path);
+        perror("execl");
+        _exit(127);
+    } else if (pid < 0) {
+        LOG_ERROR("Fork failed when starting desktop environment.");
+        perror("fork");
+        return false;
+    }
+
+    sup.pid = pid;
+    sup.starts++;
+    sup.awaiting_ready = true;
+    clock_gettime(CLOCK_MONOTONIC, &sup.spawn_time);
+    watch(pid);
+    return true;
+}
+
+static void arm_restart(long delay_ms) {
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = delay_ms / 1000;
+    its.it_value.tv_nsec = (delay_ms % 1000) * 1000000L;
+    if (timerfd_settime(sup.timer_fd, 0, &its, NULL) < 0) {
+        LOG_ERROR("Cannot schedule desktop environment restart: %s", strerror(errno));
+        return;
+    }
+    sup.restart_pending = true;
+}
+
+static void handle_restart_timer(int fd, void *data) {
+    (void)data;
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) < 0 || !sup.restart_pending)
+        return;
+    sup.restart_pending = false;
+
+    if (!spawn())
+        arm_restart(DE_RESTART_MAX_DELAY_MS);
+}
+
+/* True once DE_CRASH_LOOP_LIMIT crashes have landed inside the window. */
+static bool record_crash(void) {
+    double now = now_seconds();
+    sup.crash_times[sup.num_crashes % DE_CRASH_LOOP_LIMIT] = now;
+    sup.num_crashes++;
+    // The next slot to be overwritten holds the oldest of the last LIMIT crashes
+    double oldest = sup.crash_times[sup.num_crashes % DE_CRASH_LOOP_LIMIT];
+    return sup.num_crashes >= DE_CRASH_LOOP_LIMIT && now - oldest <= DE_CRASH_LOOP_WINDOW;
+}
+
+static void handle_exit(int fd, void *data) {
+    (void)data;
+    siginfo_t info;
+    memset(&info, 0, sizeof(info));
+    // pidfd_open() arrived in Linux 5.3 but waitid(P_PIDFD) only in 5.4;
+    // on 5.3 the pidfd still signals the exit and the pid reaps it
+    int ret = waitid((idtype_t)P_PIDFD, fd, &info, WEXITED | WNOHANG);
+    if (ret < 0 && errno == EINVAL)
+        ret = waitid(P_PID, sup.pid, &info, WEXITED | WNOHANG);
+    if (ret < 0 || info.si_pid == 0)
+        return;
+
+    event_loop_remove_fd(fd);
+    close(fd);
+    sup.pidfd = -1;
+    sup.pid = -1;
+    sup.awaiting_ready = false;
+
+    double uptime = seconds_since(&sup.spawn_time);
+    if (info.si_code == CLD_EXITED && info.si_status == 0) {
+        LOG_INFO("Desktop environment exited, ending the session.");
+        if (sup.on_session_end) sup.on_session_end();
+        return;
+    }
+
+    if (info.si_code == CLD_EXITED)
+        LOG_WARN("Desktop environment exited with status %d after %.1f s.",
+                 info.si_status, uptime);
+    else
+        LOG_WARN("Desktop environment killed by signal %d after %.1f s.",
+                 info.si_status, uptime);
+    trace_instant("de_crash");
+
+    if (record_crash()) {
+        LOG_ERROR("Desktop environment crashed %d times within %d s, not restarting.",
+                  DE_CRASH_LOOP_LIMIT, DE_CRASH_LOOP_WINDOW);
+        notification_show_from(DE_NOTIFICATION_SENDER, NOTIFY_URGENCY_CRITICAL,
+                               "Desktop crashed",
+                               "The desktop keeps crashing and will not be restarted. "
+                               "Open windows remain usable.", 10000);
+        return;
+    }
+
+    if (uptime >= DE_CRASH_LOOP_WINDOW)
+        sup.consecutive_crashes = 0;
+    int shift = sup.consecutive_crashes++;
+    long delay = DE_RESTART_DELAY_MS;
+    while (shift-- > 0 && delay < DE_RESTART_MAX_DELAY_MS)
+        delay *= 2;
+    if (delay > DE_RESTART_MAX_DELAY_MS)
+        delay = DE_RESTART_MAX_DELAY_MS;
+
+    LOG_INFO("Restarting desktop environment in %ld ms.", delay);
+    arm_restart(delay);
+}
+
+static void setup(const char *path, DeSessionEndFunc on_session_end) {
+    sup.path = path;
+    sup.on_session_end = on_session_end;
+
+    sup.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (sup.timer_fd < 0 || !event_loop_add_fd(sup.timer_fd, handle_restart_timer, NULL)) {
+        LOG_WARN("Cannot create the restart timer; a crashed DE will stay down.");
+        if (sup.timer_fd >= 0) close(sup.timer_fd);
+        sup.timer_fd = -1;
+    }
+}
+
+bool de_supervisor_start(const char *path, DeSessionEndFunc on_session_end) {
+    setup(path, on_session_end);
+    return spawn();
+}
+
+bool de_supervisor_adopt(pid_t pid, const char *path, DeSessionEndFunc on_session_end) {
+    setup(path, on_session_end);
+    if (pid <= 0)
+        return spawn();
+
+    // Still our child across the exec; its uptime restarts from here
+    sup.pid = pid;
+    sup.starts = 1;
+    clock_gettime(CLOCK_MONOTONIC, &sup.spawn_time);
+    if (watch(pid))
+        LOG_INFO("Supervising desktop environment %d from the previous image.", pid);
+    return true;
+}
+
+void de_supervisor_stop(void) {
+    if (sup.timer_fd >= 0) {
+        event_loop_remove_fd(sup.timer_fd);
+        close(sup.timer_fd);
+        sup.timer_fd = -1;
+    }
+    sup.restart_pending = false;
+
+    if (sup.pidfd >= 0) {
+        event_loop_remove_fd(sup.pidfd);
+        close(sup.pidfd);
+        sup.pidfd = -1;
+    }
+    if (sup.pid > 0) {
+        kill(sup.pid, SIGTERM);
+        waitpid(sup.pid, NULL, 0);
+        LOG_INFO("Desktop environment process %d terminated.", sup.pid);
+        sup.pid = -1;
+    }
+}
+
+void de_supervisor_handle_ready(void) {
+    if (!sup.awaiting_ready) return;
+    sup.awaiting_ready = false;
+
+    double elapsed = seconds_since(&sup.spawn_time);
+    if (sup.starts > 1)
+        LOG_INFO("Desktop environment restart %d ready after %.3f s.", sup.starts - 1, elapsed);
+    else
+        LOG_INFO("Desktop environment ready %.3f s after spawn.", elapsed);
+}
+
+pid_t de_supervisor_pid(void) {
+    return sup.pid;
+}
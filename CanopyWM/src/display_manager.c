@@ -1,13 +1,16 @@
 #include "display_manager.h"
 #include "wm.h"
+#include "xstats.h"
+#include "log.h"
 #include <stdlib.h>
+#include <string.h>
 #include <systemd/sd-bus.h>
 
 // Global display manager instance
 DisplayManager display_manager;
 
 void display_manager_init(void) {
-    display_manager.resources = XRRGetScreenResources(wm.display, wm.root);
+    display_manager.resources = X_ROUND_TRIP(XRRGetScreenResources(wm.display, wm.root));
     display_manager.displays = malloc(sizeof(CanopyDisplay) * 16);
     display_manager.num_displays = 0;
     
@@ -47,15 +50,15 @@ void display_update_all(void) {
     
     // Update with current display information
     for (int i = 0; i < display_manager.resources->noutput; i++) {
-        XRROutputInfo *output_info = XRRGetOutputInfo(wm.display, 
+        XRROutputInfo *output_info = X_ROUND_TRIP(XRRGetOutputInfo(wm.display,
                                                     display_manager.resources,
-                                                    display_manager.resources->outputs[i]);
+                                                    display_manager.resources->outputs[i]));
         
         if (output_info->connection == RR_Connected) {
             CanopyDisplay *d = &display_manager.displays[display_manager.num_displays];
             d->info = output_info;
-            d->crtc = XRRGetCrtcInfo(wm.display, display_manager.resources,
-                                    output_info->crtc);
+            d->crtc = X_ROUND_TRIP(XRRGetCrtcInfo(wm.display, display_manager.resources,
+                                                  output_info->crtc));
             d->x = d->crtc->x;
             d->y = d->crtc->y;
             d->width = d->crtc->width;
@@ -79,8 +82,16 @@ CanopyDisplay *display_get_at(int x, int y) {
     return NULL;
 }
 
+static int on_brightness_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+    (void)userdata;
+    (void)ret_error;
+    if (sd_bus_message_is_method_error(m, NULL))
+        LOG_WARN("SetBrightness failed: %s", sd_bus_message_get_error(m)->message);
+    return 0;
+}
+
 void display_set_brightness(CanopyDisplay *d, int brightness) {
-    if (!d || !d->info) return;
+    if (!d || !d->info || !wm.bus) return;
     
     // Clamp brightness value
     if (brightness < 0) brightness = 0;
@@ -88,19 +99,18 @@ void display_set_brightness(CanopyDisplay *d, int brightness) {
     
     d->brightness = brightness;
     
-    // Use systemd-logind to set actual brightness
-    sd_bus_message *m = NULL;
-    sd_bus_error error = SD_BUS_ERROR_NULL;
-    
-    sd_bus_call_method(wm.bus,
-                      "org.freedesktop.login1",
-                      "/org/freedesktop/login1/session/auto",
-                      "org.freedesktop.login1.Session",
-                      "SetBrightness",
-                      &error,
-                      &m,
-                      "ssu",
-                      "backlight",
-                      d->info->name,
-                      brightness);
+    // Use systemd-logind to set actual brightness; the reply arrives through
+    // the bus's event loop watch instead of blocking the X thread
+    int ret = sd_bus_call_method_async(wm.bus, NULL,
+                                       "org.freedesktop.login1",
+                                       "/org/freedesktop/login1/session/auto",
+                                       "org.freedesktop.login1.Session",
+                                       "SetBrightness",
+                                       on_brightness_reply, NULL,
+                                       "ssu",
+                                       "backlight",
+                                       d->info->name,
+                                       brightness);
+    if (ret < 0)
+        LOG_WARN("Cannot set the brightness of %s: %s", d->info->name, strerror(-ret));
 }
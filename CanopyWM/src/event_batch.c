@@ -0,0 +1,323 @@
+// src/event_batch.c
+#include "event_batch.h"
+#include "wm.h"
+#include "client.h"
+#include "xstats.h"
+#include "log.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#define LATENCY_BUCKETS 16             // Powers of two from 1 us
+
+static struct {
+    XEvent events[EVENT_BATCH_MAX];
+    bool skip[EVENT_BATCH_MAX];
+    int count;
+    uint64_t read_at;                  // When the batch was drained, in us
+
+    unsigned long batches;
+    unsigned long handled;
+    unsigned long max_batch;
+    unsigned long coalesced_property;
+    unsigned long coalesced_configure;
+    unsigned long coalesced_motion;
+    unsigned long input_latency[LATENCY_BUCKETS];   // Drain to handled, per input event
+} batch;
+
+// Events of throttled clients, oldest first
+static struct {
+    XEvent events[EVENT_DEFERRED_MAX];
+    int head;
+    int count;
+    int throttled_clients;
+
+    unsigned long deferred;
+    unsigned long dropped;             // PropertyNotify lost to a full queue; reread later
+    unsigned long throttles;
+} low;
+
+static uint64_t now_usec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static bool is_input(int type) {
+    return type == KeyPress || type == KeyRelease || type == ButtonPress ||
+           type == ButtonRelease || type == MotionNotify;
+}
+
+/*
+ * Events that input read after them must not overtake: they change the
+ * keymap, the focus or the window under the pointer, which decide where
+ * that input goes.
+ */
+static bool is_barrier(const XEvent *ev) {
+    switch (ev->type) {
+    case MappingNotify:
+    case FocusIn:
+    case FocusOut:
+    case EnterNotify:
+    case LeaveNotify:
+        return true;
+    case ClientMessage:
+        return ev->xclient.message_type == wm.atoms[NET_ACTIVE_WINDOW];
+    default:
+        return false;
+    }
+}
+
+/* Whether ev is made redundant by later, an event after it in the batch */
+static bool supersedes(const XEvent *later, const XEvent *ev) {
+    if (later->type != ev->type)
+        return false;
+    switch (ev->type) {
+    case PropertyNotify:
+        return later->xproperty.window == ev->xproperty.window &&
+               later->xproperty.atom == ev->xproperty.atom;
+    case ConfigureRequest:
+        // The later request must set every field this one sets
+        return later->xconfigurerequest.window == ev->xconfigurerequest.window &&
+               (later->xconfigurerequest.value_mask & ev->xconfigurerequest.value_mask) ==
+               ev->xconfigurerequest.value_mask;
+    default:
+        return false;
+    }
+}
+
+static void mark_coalesced(void) {
+    for (int i = 0; i < batch.count; i++) {
+        const XEvent *ev = &batch.events[i];
+        batch.skip[i] = false;
+
+        if (ev->type == MotionNotify) {
+            // Only the last of a run of motion on one window matters
+            if (i + 1 < batch.count && batch.events[i + 1].type == MotionNotify &&
+                batch.events[i + 1].xmotion.window == ev->xmotion.window) {
+                batch.skip[i] = true;
+                batch.coalesced_motion++;
+            }
+            continue;
+        }
+        if (ev->type != PropertyNotify && ev->type != ConfigureRequest)
+            continue;
+        for (int j = i + 1; j < batch.count; j++) {
+            if (supersedes(&batch.events[j], ev)) {
+                batch.skip[i] = true;
+                if (ev->type == PropertyNotify)
+                    batch.coalesced_property++;
+                else
+                    batch.coalesced_configure++;
+                break;
+            }
+        }
+    }
+}
+
+static void handle(XEvent *ev) {
+    xstats_begin(ev->type);
+    wm_handle_event(ev);
+    xstats_end();
+    batch.handled++;
+}
+
+/* The window an event is about, for charging it to a client */
+static Window event_window(const XEvent *ev) {
+    switch (ev->type) {
+    case ConfigureRequest: return ev->xconfigurerequest.window;
+    case MapRequest: return ev->xmaprequest.window;
+    case DestroyNotify: return ev->xdestroywindow.window;
+    default: return ev->xany.window;
+    }
+}
+
+static void throttle(Client *c, double now) {
+    pid_t pid = props_pid(&c->props, c->window);
+    const char *title = client_title(c);
+    LOG_WARN("Client 0x%lx (pid %d, \"%s\") sent over %d events in %.0f ms, throttling it.",
+             c->window, (int)pid, title ? title : "", CLIENT_EVENT_BUDGET, CLIENT_EVENT_WINDOW_MS);
+    client_set_throttled(c, true);
+    c->throttled_until = now + CLIENT_THROTTLE_MS;
+    low.throttled_clients++;
+    low.throttles++;
+}
+
+/* Count an event against its client; true if the client is throttled */
+static bool charge(Client *c, double now) {
+    if (now - c->event_window_start >= CLIENT_EVENT_WINDOW_MS) {
+        c->event_window_start = now;
+        c->window_events = 0;
+    }
+    if (++c->window_events > CLIENT_EVENT_BUDGET) {
+        if (!c->throttled)
+            throttle(c, now);
+        else
+            c->throttled_until = now + CLIENT_THROTTLE_MS;
+    }
+    return c->throttled;
+}
+
+/*
+ * Remove the deferred events about a client's window or frame, handling
+ * them in order if run is set. The windows are passed rather than the
+ * client, which handling an event may free.
+ */
+static void take_deferred(Window window, Window frame, bool run) {
+    int kept = 0;
+    for (int i = 0; i < low.count; i++) {
+        XEvent ev = low.events[(low.head + i) % EVENT_DEFERRED_MAX];
+        Window w = event_window(&ev);
+        if (w != window && w != frame) {
+            low.events[(low.head + kept++) % EVENT_DEFERRED_MAX] = ev;
+            continue;
+        }
+        if (run)
+            handle(&ev);
+    }
+    low.count = kept;
+}
+
+static void defer(Client *c, XEvent *ev) {
+    if (low.count == EVENT_DEFERRED_MAX) {
+        if (ev->type == PropertyNotify) {
+            low.dropped++;     // The client's properties are reread when it is let go
+            return;
+        }
+        // Handled now, so the client's older deferred events have to go first
+        take_deferred(c->window, c->frame, true);
+        handle(ev);
+        return;
+    }
+    low.events[(low.head + low.count) % EVENT_DEFERRED_MAX] = *ev;
+    low.count++;
+    low.deferred++;
+    c->events_deferred++;
+}
+
+static void run_deferred(void) {
+    for (int i = 0; i < EVENT_DEFERRED_PER_ITERATION && low.count > 0; i++) {
+        XEvent ev = low.events[low.head];
+        low.head = (low.head + 1) % EVENT_DEFERRED_MAX;
+        low.count--;
+        handle(&ev);
+    }
+}
+
+/* Let go of clients quiet for long enough, once their deferred events are handled */
+static void release_throttled(double now) {
+    if (low.throttled_clients == 0 || low.count > 0)
+        return;
+    // Recounted rather than decremented, as throttled clients may be removed
+    low.throttled_clients = 0;
+    for (Client *c = client_first(); c; c = client_next(c)) {
+        if (!c->throttled)
+            continue;
+        if (now >= c->throttled_until) {
+            LOG_INFO("Client 0x%lx is within its event budget again.", c->window);
+            client_set_throttled(c, false);
+        } else {
+            low.throttled_clients++;
+        }
+    }
+}
+
+/* Handle a non-input event, or defer it if its client is throttled */
+static void dispatch_other(int i, double now) {
+    XEvent *ev = &batch.events[i];
+    if (ev->type == DestroyNotify) {
+        // Nothing deferred for a destroyed window can be handled any more
+        Client *gone = client_find_by_window(ev->xdestroywindow.window);
+        if (gone)
+            take_deferred(gone->window, gone->frame, false);
+        else
+            take_deferred(ev->xdestroywindow.window, None, false);
+    }
+    // Coalesced events count too: the budget is on what the client sends
+    Client *c = ev->type == DestroyNotify ? NULL : client_find_by_window(event_window(ev));
+    bool throttled = c && charge(c, now);
+    if (batch.skip[i])
+        return;
+    if (throttled)
+        defer(c, ev);
+    else
+        handle(ev);
+}
+
+static void record_latency(void) {
+    uint64_t elapsed = now_usec() - batch.read_at;
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && elapsed >= (2ull << bucket))
+        bucket++;
+    batch.input_latency[bucket]++;
+}
+
+void event_batch_dispatch(Display *dpy) {
+    while (XPending(dpy)) {
+        batch.count = 0;
+        while (batch.count < EVENT_BATCH_MAX && XQLength(dpy) > 0)
+            XNextEvent(dpy, &batch.events[batch.count++]);
+        batch.read_at = now_usec();
+        batch.batches++;
+        if ((unsigned long)batch.count > batch.max_batch)
+            batch.max_batch = batch.count;
+
+        mark_coalesced();
+        double now = batch.read_at / 1000.0;
+        for (int start = 0; start < batch.count; ) {
+            // Input goes ahead of the other events, but not past a barrier
+            int end = start;
+            while (end < batch.count && !is_barrier(&batch.events[end]))
+                end++;
+            for (int i = start; i < end; i++) {
+                if (!batch.skip[i] && is_input(batch.events[i].type)) {
+                    handle(&batch.events[i]);
+                    record_latency();
+                }
+            }
+            for (int i = start; i < end; i++) {
+                if (!is_input(batch.events[i].type))
+                    dispatch_other(i, now);
+            }
+            if (end < batch.count)
+                dispatch_other(end, now);
+            start = end + 1;
+        }
+    }
+
+    run_deferred();
+    release_throttled(now_usec() / 1000.0);
+}
+
+/* Upper bound of the bucket holding the given fraction of input events */
+static unsigned long latency_percentile(double fraction) {
+    unsigned long total = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++)
+        total += batch.input_latency[i];
+    if (total == 0)
+        return 0;
+
+    unsigned long seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += batch.input_latency[i];
+        if (seen >= fraction * total)
+            return 2ul << i;
+    }
+    return 2ul << (LATENCY_BUCKETS - 1);
+}
+
+void event_batch_dump_stats(void) {
+    LOG_INFO("X event batches: %lu, %lu events handled, largest batch %lu",
+             batch.batches, batch.handled, batch.max_batch);
+    LOG_INFO("  coalesced: %lu PropertyNotify, %lu ConfigureRequest, %lu MotionNotify",
+             batch.coalesced_property, batch.coalesced_configure, batch.coalesced_motion);
+    LOG_INFO("  %lu clients throttled, %lu events deferred, %lu dropped, %d queued",
+             low.throttles, low.deferred, low.dropped, low.count);
+    for (Client *c = client_first(); c; c = client_next(c)) {
+        if (c->events_deferred)
+            LOG_INFO("    0x%lx %lu events deferred%s", c->window, c->events_deferred,
+                     c->throttled ? " (throttled)" : "");
+    }
+    LOG_INFO("  input handled within %lu us (p50), %lu us (p99) of being read",
+             latency_percentile(0.5), latency_percentile(0.99));
+}
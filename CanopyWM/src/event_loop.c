@@ -0,0 +1,151 @@
+// src/event_loop.c
+#include "event_loop.h"
+#include "trace.h"
+#include "log.h"
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/select.h>
+#include <time.h>
+
+#define BUSY_BUCKETS 5
+
+// Upper bounds of the busy time histogram buckets; the last one is open
+static const uint64_t busy_bucket_usec[BUSY_BUCKETS - 1] = { 250, 1000, 4000, 16000 };
+
+typedef struct {
+    int fd;
+    EventLoopCallback callback;
+    void *data;
+    uint64_t max_usec;             // Longest single callback run
+    unsigned long over_budget;
+} EventLoopWatch;
+
+static EventLoopWatch watches[EVENT_LOOP_MAX_FDS];
+static int num_watches = 0;
+
+static struct {
+    uint64_t woke_at;              // When select() last returned, 0 before the first wait
+    uint64_t iterations;
+    uint64_t total_usec;
+    uint64_t max_usec;
+    unsigned long buckets[BUSY_BUCKETS];
+    unsigned long over_budget;
+} busy;
+
+static uint64_t now_usec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Time since select() returned: everything the main thread did in between */
+static void record_busy(uint64_t now) {
+    if (!busy.woke_at)
+        return;
+    uint64_t elapsed = now - busy.woke_at;
+    busy.iterations++;
+    busy.total_usec += elapsed;
+    if (elapsed > busy.max_usec)
+        busy.max_usec = elapsed;
+
+    int bucket = 0;
+    while (bucket < BUSY_BUCKETS - 1 && elapsed >= busy_bucket_usec[bucket])
+        bucket++;
+    busy.buckets[bucket]++;
+
+    if (elapsed > EVENT_LOOP_BUSY_BUDGET_USEC) {
+        busy.over_budget++;
+        trace_end("main_loop_blocked", busy.woke_at);
+    }
+}
+
+bool event_loop_add_fd(int fd, EventLoopCallback callback, void *data) {
+    if (fd < 0 || fd >= FD_SETSIZE || num_watches >= EVENT_LOOP_MAX_FDS) {
+        LOG_ERROR("Cannot watch file descriptor %d.", fd);
+        return false;
+    }
+    watches[num_watches].fd = fd;
+    watches[num_watches].callback = callback;
+    watches[num_watches].data = data;
+    watches[num_watches].max_usec = 0;
+    watches[num_watches].over_budget = 0;
+    num_watches++;
+    return true;
+}
+
+void event_loop_remove_fd(int fd) {
+    for (int i = 0; i < num_watches; i++) {
+        if (watches[i].fd == fd) {
+            // Callbacks may remove descriptors while we dispatch, so only
+            // mark the slot here and compact it after the dispatch pass.
+            watches[i].fd = -1;
+        }
+    }
+}
+
+static void event_loop_compact(void) {
+    int j = 0;
+    for (int i = 0; i < num_watches; i++) {
+        if (watches[i].fd >= 0)
+            watches[j++] = watches[i];
+    }
+    num_watches = j;
+}
+
+void event_loop_wait(int xfd, long timeout_usec) {
+    record_busy(now_usec());
+
+    struct timeval tv = { timeout_usec / 1000000, timeout_usec % 1000000 };
+    fd_set fds;
+    int max_fd = xfd;
+
+    FD_ZERO(&fds);
+    FD_SET(xfd, &fds);
+    for (int i = 0; i < num_watches; i++) {
+        if (watches[i].fd < 0) continue;
+        FD_SET(watches[i].fd, &fds);
+        if (watches[i].fd > max_fd)
+            max_fd = watches[i].fd;
+    }
+
+    int ready = select(max_fd + 1, &fds, NULL, NULL, &tv);
+    busy.woke_at = now_usec();
+    if (ready < 0) {
+        if (errno != EINTR)
+            LOG_WARN("select failed: %s", strerror(errno));
+        return;
+    }
+
+    int count = num_watches;
+    for (int i = 0; i < count; i++) {
+        int fd = watches[i].fd;
+        if (fd < 0 || !FD_ISSET(fd, &fds))
+            continue;
+        uint64_t start = now_usec();
+        watches[i].callback(fd, watches[i].data);
+        uint64_t elapsed = now_usec() - start;
+        if (elapsed > watches[i].max_usec)
+            watches[i].max_usec = elapsed;
+        if (elapsed > EVENT_LOOP_BUSY_BUDGET_USEC)
+            watches[i].over_budget++;
+    }
+    event_loop_compact();
+}
+
+void event_loop_dump_stats(void) {
+    LOG_INFO("Main thread busy per iteration: %llu iterations, mean %.0f us, max %llu us, "
+             "%lu over %d us",
+             (unsigned long long)busy.iterations,
+             busy.iterations ? (double)busy.total_usec / busy.iterations : 0.0,
+             (unsigned long long)busy.max_usec, busy.over_budget, EVENT_LOOP_BUSY_BUDGET_USEC);
+    LOG_INFO("  <250us %lu  <1ms %lu  <4ms %lu  <16ms %lu  >=16ms %lu",
+             busy.buckets[0], busy.buckets[1], busy.buckets[2], busy.buckets[3],
+             busy.buckets[4]);
+    for (int i = 0; i < num_watches; i++) {
+        if (watches[i].fd < 0 || watches[i].max_usec == 0)
+            continue;
+        LOG_INFO("  fd %-3d callback max %llu us, %lu over budget", watches[i].fd,
+                 (unsigned long long)watches[i].max_usec, watches[i].over_budget);
+    }
+}
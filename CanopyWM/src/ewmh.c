@@ -0,0 +1,177 @@
+// src/ewmh.c
+#include "ewmh.h"
+#include "restart.h"
+#include "wm.h"
+#include "xstats.h"
+#include "log.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct {
+    Window check;                  // _NET_SUPPORTING_WM_CHECK window
+    Window *clients;               // Mapping order, oldest first
+    Window *stacking;              // Bottom to top
+    int count;
+    int capacity;
+    bool clients_dirty;
+    bool stacking_dirty;
+    Window active;
+    bool active_dirty;
+} ewmh;
+
+static void set_windows(Atom prop, const Window *windows, int count) {
+    XChangeProperty(wm.display, wm.root, prop, XA_WINDOW, 32, PropModeReplace,
+                    (const unsigned char *)windows, count);
+}
+
+static void append_window(Atom prop, Window window) {
+    XChangeProperty(wm.display, wm.root, prop, XA_WINDOW, 32, PropModeAppend,
+                    (const unsigned char *)&window, 1);
+}
+
+static int find(const Window *list, Window window) {
+    for (int i = 0; i < ewmh.count; i++) {
+        if (list[i] == window)
+            return i;
+    }
+    return -1;
+}
+
+/* The check window of the image before a restart survives it; drop it */
+static void destroy_previous_check(void) {
+    Atom type;
+    int format;
+    unsigned long items, after;
+    unsigned char *data = NULL;
+    if (X_ROUND_TRIP(XGetWindowProperty(wm.display, wm.root, wm.atoms[NET_SUPPORTING_WM_CHECK],
+                                        0, 1, False, XA_WINDOW, &type, &format, &items,
+                                        &after, &data)) == Success &&
+        data && items == 1) {
+        Window previous = *(Window *)data;
+        if (previous && previous != ewmh.check)
+            XDestroyWindow(wm.display, previous);
+    }
+    if (data) XFree(data);
+}
+
+void ewmh_init(void) {
+    if (restart_state())
+        destroy_previous_check();
+
+    ewmh.check = XCreateSimpleWindow(wm.display, wm.root, -1, -1, 1, 1, 0, 0, 0);
+    XChangeProperty(wm.display, ewmh.check, wm.atoms[NET_SUPPORTING_WM_CHECK], XA_WINDOW, 32,
+                    PropModeReplace, (unsigned char *)&ewmh.check, 1);
+    XChangeProperty(wm.display, ewmh.check, wm.atoms[NET_WM_NAME], wm.atoms[UTF8_STRING], 8,
+                    PropModeReplace, (unsigned char *)"CanopyWM", strlen("CanopyWM"));
+    XChangeProperty(wm.display, wm.root, wm.atoms[NET_SUPPORTING_WM_CHECK], XA_WINDOW, 32,
+                    PropModeReplace, (unsigned char *)&ewmh.check, 1);
+
+    Atom supported[] = {
+        wm.atoms[NET_SUPPORTED],
+        wm.atoms[NET_SUPPORTING_WM_CHECK],
+        wm.atoms[NET_CLIENT_LIST],
+        wm.atoms[NET_CLIENT_LIST_STACKING],
+        wm.atoms[NET_ACTIVE_WINDOW],
+        wm.atoms[NET_WM_NAME],
+        wm.atoms[NET_WM_PING],
+        wm.atoms[NET_WM_STATE],
+        wm.atoms[NET_WM_STATE_FULLSCREEN],
+    };
+    XChangeProperty(wm.display, wm.root, wm.atoms[NET_SUPPORTED], XA_ATOM, 32,
+                    PropModeReplace, (unsigned char *)supported,
+                    sizeof(supported) / sizeof(supported[0]));
+
+    // Start from empty lists; clients are appended as they are managed
+    set_windows(wm.atoms[NET_CLIENT_LIST], NULL, 0);
+    set_windows(wm.atoms[NET_CLIENT_LIST_STACKING], NULL, 0);
+    ewmh.active = None;
+    set_windows(wm.atoms[NET_ACTIVE_WINDOW], &ewmh.active, 1);
+}
+
+void ewmh_cleanup(void) {
+    XDeleteProperty(wm.display, wm.root, wm.atoms[NET_CLIENT_LIST]);
+    XDeleteProperty(wm.display, wm.root, wm.atoms[NET_CLIENT_LIST_STACKING]);
+    XDeleteProperty(wm.display, wm.root, wm.atoms[NET_ACTIVE_WINDOW]);
+    XDeleteProperty(wm.display, wm.root, wm.atoms[NET_SUPPORTING_WM_CHECK]);
+    if (ewmh.check) {
+        XDestroyWindow(wm.display, ewmh.check);
+        ewmh.check = None;
+    }
+    free(ewmh.clients);
+    free(ewmh.stacking);
+    memset(&ewmh, 0, sizeof(ewmh));
+}
+
+void ewmh_client_added(Window window) {
+    if (find(ewmh.clients, window) >= 0)
+        return;
+
+    if (ewmh.count == ewmh.capacity) {
+        int capacity = ewmh.capacity ? ewmh.capacity * 2 : 32;
+        Window *clients = realloc(ewmh.clients, capacity * sizeof(Window));
+        if (!clients) return;
+        ewmh.clients = clients;
+        Window *stacking = realloc(ewmh.stacking, capacity * sizeof(Window));
+        if (!stacking) return;
+        ewmh.stacking = stacking;
+        ewmh.capacity = capacity;
+    }
+
+    // New clients go on top; a pending rewrite already covers the append
+    ewmh.clients[ewmh.count] = window;
+    ewmh.stacking[ewmh.count] = window;
+    ewmh.count++;
+    if (!ewmh.clients_dirty)
+        append_window(wm.atoms[NET_CLIENT_LIST], window);
+    if (!ewmh.stacking_dirty)
+        append_window(wm.atoms[NET_CLIENT_LIST_STACKING], window);
+}
+
+void ewmh_client_removed(Window window) {
+    int i = find(ewmh.clients, window);
+    if (i < 0)
+        return;
+    memmove(&ewmh.clients[i], &ewmh.clients[i + 1], (ewmh.count - i - 1) * sizeof(Window));
+
+    int j = find(ewmh.stacking, window);
+    memmove(&ewmh.stacking[j], &ewmh.stacking[j + 1], (ewmh.count - j - 1) * sizeof(Window));
+    ewmh.count--;
+    ewmh.clients_dirty = true;
+    ewmh.stacking_dirty = true;
+
+    if (ewmh.active == window)
+        ewmh_set_active(None);
+}
+
+void ewmh_client_raised(Window window) {
+    int i = find(ewmh.stacking, window);
+    if (i < 0 || i == ewmh.count - 1)
+        return;
+
+    memmove(&ewmh.stacking[i], &ewmh.stacking[i + 1], (ewmh.count - i - 1) * sizeof(Window));
+    ewmh.stacking[ewmh.count - 1] = window;
+    ewmh.stacking_dirty = true;
+}
+
+void ewmh_set_active(Window window) {
+    if (window != ewmh.active) {
+        ewmh.active = window;
+        ewmh.active_dirty = true;
+    }
+}
+
+void ewmh_flush(void) {
+    if (ewmh.clients_dirty) {
+        set_windows(wm.atoms[NET_CLIENT_LIST], ewmh.clients, ewmh.count);
+        ewmh.clients_dirty = false;
+    }
+    if (ewmh.stacking_dirty) {
+        set_windows(wm.atoms[NET_CLIENT_LIST_STACKING], ewmh.stacking, ewmh.count);
+        ewmh.stacking_dirty = false;
+    }
+    if (ewmh.active_dirty) {
+        set_windows(wm.atoms[NET_ACTIVE_WINDOW], &ewmh.active, 1);
+        ewmh.active_dirty = false;
+    }
+}
@@ -2,8 +2,13 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define MAX_LINE 1000
+#define VIEW_STACK_BUFFER 16384
 #define MAX_SECTION 50
 #define MAX_NAME 50
 
@@ -58,6 +63,7 @@ static int ini_parse_stream(FILE* file, ini_handler handler, void* user) {
         if (*end != '=')
             continue;
 
+        *end = '\0';
         name = rstrip(start);
         value = lskip(end + 1);
         end = find_char_or_comment(value, '\0');
@@ -79,3 +85,107 @@ int ini_parse(const char* filename, ini_handler handler, void* user) {
     fclose(file);
     return error;
 }
+
+/* -- Zero-copy parser -- */
+
+static const char* view_lskip(const char* p, const char* end) {
+    while (p < end && isspace((unsigned char)*p))
+        p++;
+    return p;
+}
+
+static const char* view_rskip(const char* start, const char* p) {
+    while (p > start && isspace((unsigned char)p[-1]))
+        p--;
+    return p;
+}
+
+/* Like find_char_or_comment(), but bounded and built on memchr so glibc's
+   vectorized search does the scanning. Pass c = 0 to stop at comments only. */
+static const char* view_find_char_or_comment(const char* p, const char* end, char c) {
+    const char* limit = end;
+    const char* hit;
+
+    if (c && (hit = memchr(p, c, limit - p)))
+        limit = hit;
+    if ((hit = memchr(p, ';', limit - p)))
+        limit = hit;
+    if ((hit = memchr(p, '#', limit - p)))
+        limit = hit;
+    return limit;
+}
+
+int ini_parse_buffer(const char* data, size_t len, ini_view_handler handler, void* user) {
+    const char* p = data;
+    const char* end = data + len;
+    IniStr section = { "", 0 };
+
+    while (p < end) {
+        const char* eol = memchr(p, '\n', end - p);
+        if (!eol)
+            eol = end;
+
+        const char* start = view_lskip(p, eol);
+        const char* stop = view_rskip(start, eol);
+        p = eol < end ? eol + 1 : end;
+
+        if (start == stop || *start == ';' || *start == '#')
+            continue;
+
+        if (*start == '[') {
+            const char* close = view_find_char_or_comment(start + 1, stop, ']');
+            if (close < stop && *close == ']') {
+                section.ptr = start + 1;
+                section.len = close - section.ptr;
+            }
+            continue;
+        }
+
+        const char* equals = view_find_char_or_comment(start, stop, '=');
+        if (equals == stop || *equals != '=')
+            continue;
+
+        IniStr name = { start, view_rskip(start, equals) - start };
+        const char* value_start = view_lskip(equals + 1, stop);
+        const char* value_end = view_find_char_or_comment(value_start, stop, 0);
+        IniStr value = { value_start, view_rskip(value_start, value_end) - value_start };
+
+        if (handler(user, section, name, value) < 0)
+            return 0;
+    }
+    return 1;
+}
+
+int ini_parse_view(const char* filename, ini_view_handler handler, void* user) {
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 1;
+    }
+
+    /* Typical config files are a few hundred bytes, where one read() into
+       the stack is cheaper than setting up and tearing down a mapping. */
+    if (st.st_size <= VIEW_STACK_BUFFER) {
+        char buf[VIEW_STACK_BUFFER];
+        ssize_t n = read(fd, buf, sizeof(buf));
+        close(fd);
+        return n < 0 ? -1 : ini_parse_buffer(buf, n, handler, user);
+    }
+
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    int result = ini_parse_buffer(map, st.st_size, handler, user);
+    munmap(map, st.st_size);
+    return result;
+}
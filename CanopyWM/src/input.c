@@ -3,41 +3,515 @@
 #include "input.h"
 #include "wm.h"
 #include "client.h"
+#include "config.h"
+#include "ewmh.h"
+#include "restart.h"
+#include "xstats.h"
+#include "log.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 // Global input manager instance
 InputManager input_manager;
 
+/* -- Actions -- */
+
+static void action_focus_next(const InputArg *arg) {
+    (void)arg;
+    client_focus_next();
+}
+
+static void action_cycle_focus(const InputArg *arg) {
+    (void)arg;
+    client_cycle_focus();
+}
+
+static void action_close(const InputArg *arg) {
+    (void)arg;
+    client_close_focused();
+}
+
+static void action_fullscreen(const InputArg *arg) {
+    (void)arg;
+    client_toggle_fullscreen_focused();
+}
+
+// Run a shell command, double-forking so the child is reparented to init
+static void action_spawn(const InputArg *arg) {
+    if (!arg->str) return;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (fork() == 0) {
+            setsid();
+            execl("/bin/sh", "sh", "-c", arg->str, (char *)NULL);
+            _exit(127);
+        }
+        _exit(0);
+    } else if (pid > 0) {
+        waitpid(pid, NULL, 0);
+    } else {
+        LOG_WARN("Cannot spawn '%s'", arg->str);
+    }
+}
+
+static void action_mode(const InputArg *arg) {
+    input_set_mode(arg->mode);
+}
+
+static void action_move(const InputArg *arg) {
+    Client *c = client_manager.focused;
+    if (c && !client_is_fullscreen(c))
+        client_move(c, CLIENT_X(c) + arg->x, CLIENT_Y(c) + arg->y);
+}
+
+static void action_resize(const InputArg *arg) {
+    Client *c = client_manager.focused;
+    if (!c || client_is_fullscreen(c)) return;
+
+    int width = (int)CLIENT_WIDTH(c) + arg->x;
+    int height = (int)CLIENT_HEIGHT(c) + arg->y;
+    client_resize(wm.display, c, width > 1 ? width : 1, height > 1 ? height : 1);
+}
+
+// Replace the running image with the binary on disk, keeping every client
+static void action_restart(const InputArg *arg) {
+    (void)arg;
+    restart_exec();
+}
+
+// Actions that can be bound from the [keybinds] config sections
+static const InputAction input_actions[] = {
+    { "focus_next",  action_focus_next },
+    { "cycle_focus", action_cycle_focus },
+    { "close",       action_close },
+    { "fullscreen",  action_fullscreen },
+    { "spawn",       action_spawn },
+    { "mode",        action_mode },
+    { "move",        action_move },
+    { "resize",      action_resize },
+    { "restart",     action_restart },
+};
+
+static const InputAction *input_find_action(const char *name, size_t len) {
+    for (size_t i = 0; i < sizeof(input_actions) / sizeof(input_actions[0]); i++) {
+        if (strlen(input_actions[i].name) == len &&
+            strncmp(input_actions[i].name, name, len) == 0)
+            return &input_actions[i];
+    }
+    return NULL;
+}
+
+/* -- Parsing, done once per config load -- */
+
+// Parse a key combination such as "Alt+Shift+q"
+static bool input_parse_keys(const char *spec, KeySym *key, unsigned int *modifiers) {
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s", spec);
+
+    *key = NoSymbol;
+    *modifiers = 0;
+    for (char *save = NULL, *tok = strtok_r(buf, "+", &save); tok;
+         tok = strtok_r(NULL, "+", &save)) {
+        if (strcasecmp(tok, "Alt") == 0 || strcasecmp(tok, "Mod1") == 0)
+            *modifiers |= Mod1Mask;
+        else if (strcasecmp(tok, "Shift") == 0)
+            *modifiers |= ShiftMask;
+        else if (strcasecmp(tok, "Ctrl") == 0 || strcasecmp(tok, "Control") == 0)
+            *modifiers |= ControlMask;
+        else if (strcasecmp(tok, "Super") == 0 || strcasecmp(tok, "Mod4") == 0)
+            *modifiers |= Mod4Mask;
+        else
+            *key = XStringToKeysym(tok);
+    }
+    return *key != NoSymbol;
+}
+
+// Parse a space-separated key sequence such as "Super+w h"
+static bool input_parse_sequence(const char *spec, Keybind *bind) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", spec);
+
+    bind->length = 0;
+    for (char *save = NULL, *tok = strtok_r(buf, " \t", &save); tok;
+         tok = strtok_r(NULL, " \t", &save)) {
+        if (bind->length == INPUT_MAX_CHORD)
+            return false;
+        if (!input_parse_keys(tok, &bind->keys[bind->length], &bind->modifiers[bind->length]))
+            return false;
+        bind->length++;
+    }
+    return bind->length > 0;
+}
+
+static int input_find_mode(const char *name) {
+    if (!name || strcmp(name, "default") == 0)
+        return INPUT_DEFAULT_MODE;
+    for (int i = 1; i < input_manager.num_modes; i++) {
+        if (strcmp(input_manager.modes[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static int input_add_mode(const char *name) {
+    int mode = input_find_mode(name);
+    if (mode >= 0)
+        return mode;
+    if (input_manager.num_modes >= INPUT_MAX_MODES) {
+        LOG_WARN("Too many keybinding modes, ignoring '%s'", name);
+        return -1;
+    }
+    input_manager.modes[input_manager.num_modes] = strdup(name);
+    return input_manager.num_modes++;
+}
+
+// Split "spawn xterm -e htop" into its action and a pre-parsed argument
+static bool input_parse_action(const char *spec, Keybind *bind) {
+    size_t len = strcspn(spec, " \t");
+    const char *rest = spec + len + strspn(spec + len, " \t");
+
+    bind->action = input_find_action(spec, len);
+    if (!bind->action)
+        return false;
+
+    memset(&bind->arg, 0, sizeof(bind->arg));
+    if (*rest)
+        bind->arg.str = strdup(rest);
+    if (bind->action->callback == action_mode) {
+        bind->arg.mode = input_add_mode(*rest ? rest : "default");
+        if (bind->arg.mode < 0) {
+            free(bind->arg.str);
+            bind->arg.str = NULL;
+            return false;
+        }
+    }
+    sscanf(rest, "%d %d", &bind->arg.x, &bind->arg.y);
+    return true;
+}
+
+static void input_free_keybinds(void) {
+    for (int i = 0; i < input_manager.num_keybinds; i++)
+        free(input_manager.keybinds[i].arg.str);
+    input_manager.num_keybinds = 0;
+
+    for (int i = 1; i < input_manager.num_modes; i++)
+        free(input_manager.modes[i]);
+    input_manager.num_modes = 1;
+}
+
+/* -- Trie -- */
+
+// Strip lock and pointer-button bits, which must not affect matching
+static unsigned int input_clean_mask(unsigned int state) {
+    unsigned int locks = LockMask | wm.num_lock_mask | wm.scroll_lock_mask;
+    return state & ~locks &
+           (ShiftMask | ControlMask | Mod1Mask | Mod2Mask | Mod3Mask | Mod4Mask | Mod5Mask);
+}
+
+static unsigned int input_keymap_hash(int parent, KeyCode keycode, unsigned int modifiers) {
+    return ((unsigned int)parent * 2654435761u + (unsigned int)keycode * 31u + modifiers) &
+           (KEYMAP_SLOTS - 1);
+}
+
+// Find the edge leaving parent for this key, or the empty slot it would go in
+static KeymapEntry *input_keymap_lookup(int parent, KeyCode keycode, unsigned int modifiers) {
+    unsigned int slot = input_keymap_hash(parent, keycode, modifiers);
+    for (int probe = 0; probe < KEYMAP_SLOTS; probe++) {
+        KeymapEntry *entry = &input_manager.keymap[slot];
+        if (entry->keycode == 0 ||
+            (entry->parent == parent && entry->keycode == keycode &&
+             entry->modifiers == modifiers))
+            return entry;
+        slot = (slot + 1) & (KEYMAP_SLOTS - 1);
+    }
+    return NULL;
+}
+
+static int input_new_node(void) {
+    if (input_manager.num_nodes >= input_manager.nodes_capacity) {
+        input_manager.nodes_capacity = input_manager.nodes_capacity ? input_manager.nodes_capacity * 2 : 32;
+        input_manager.nodes = realloc(input_manager.nodes,
+                                      sizeof(KeyNode) * input_manager.nodes_capacity);
+    }
+    KeyNode *node = &input_manager.nodes[input_manager.num_nodes];
+    node->binding = -1;
+    node->num_children = 0;
+    return input_manager.num_nodes++;
+}
+
+// Collect every combination of CapsLock, NumLock and ScrollLock so a grab
+// fires regardless of which of them happen to be on
+static void input_compute_lock_masks(void) {
+    unsigned int locks[3];
+    int num_locks = 0;
+    unsigned int candidates[] = { LockMask, wm.num_lock_mask, wm.scroll_lock_mask };
+
+    for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+        bool seen = candidates[i] == 0;
+        for (int j = 0; j < num_locks && !seen; j++)
+            seen = locks[j] == candidates[i];
+        if (!seen)
+            locks[num_locks++] = candidates[i];
+    }
+
+    input_manager.num_lock_masks = 1 << num_locks;
+    for (int combo = 0; combo < input_manager.num_lock_masks; combo++) {
+        unsigned int mask = 0;
+        for (int j = 0; j < num_locks; j++) {
+            if (combo & (1 << j))
+                mask |= locks[j];
+        }
+        input_manager.lock_masks[combo] = mask;
+    }
+}
+
+static void input_compute_modifier_keycodes(void) {
+    memset(input_manager.modifier_keycodes, 0, sizeof(input_manager.modifier_keycodes));
+
+    XModifierKeymap *modmap = X_ROUND_TRIP(XGetModifierMapping(wm.display));
+    if (!modmap)
+        return;
+    for (int i = 0; i < 8 * modmap->max_keypermod; i++) {
+        if (modmap->modifiermap[i])
+            input_manager.modifier_keycodes[modmap->modifiermap[i]] = true;
+    }
+    XFreeModifiermap(modmap);
+}
+
+/*
+ * Undo the edges a failed insertion created, newest first. They are the
+ * most recent entries in the table and the most recent nodes, so clearing
+ * them cannot break another entry's probe chain.
+ */
+static void input_keymap_rollback(KeymapEntry **created, int count) {
+    while (count-- > 0) {
+        KeymapEntry *entry = created[count];
+        if (entry->parent == INPUT_DEFAULT_MODE) {
+            for (int i = 0; i < input_manager.num_lock_masks; i++) {
+                XUngrabKey(wm.display, entry->keycode,
+                           entry->modifiers | input_manager.lock_masks[i], wm.root);
+            }
+        }
+        input_manager.nodes[entry->parent].num_children--;
+        input_manager.num_nodes--;
+        memset(entry, 0, sizeof(*entry));
+    }
+}
+
+/*
+ * Insert one binding into the trie, creating prefix nodes as needed. Only
+ * the first key of a default-mode sequence is grabbed; the rest of a chord
+ * and all mode bindings are read through a keyboard grab instead. A
+ * binding that is rejected partway leaves no prefix nodes or grabs behind.
+ */
+static void input_keymap_insert(int index) {
+    const Keybind *bind = &input_manager.keybinds[index];
+    KeymapEntry *created[INPUT_MAX_CHORD];
+    int num_created = 0;
+    int node = bind->mode;
+
+    for (int step = 0; step < bind->length; step++) {
+        KeyCode keycode = XKeysymToKeycode(wm.display, bind->keys[step]);
+        if (keycode == 0) {
+            const char *name = XKeysymToString(bind->keys[step]);
+            LOG_WARN("No keycode for keysym '%s' in the current keymap", name ? name : "?");
+            input_keymap_rollback(created, num_created);
+            return;
+        }
+
+        unsigned int modifiers = input_clean_mask(bind->modifiers[step]);
+        KeymapEntry *entry = input_keymap_lookup(node, keycode, modifiers);
+        if (!entry) {
+            LOG_WARN("Keybinding table full, ignoring '%s' binding", bind->action->name);
+            input_keymap_rollback(created, num_created);
+            return;
+        }
+        bool last = step == bind->length - 1;
+
+        if (entry->keycode == 0) {
+            entry->parent = node;
+            entry->keycode = keycode;
+            entry->modifiers = modifiers;
+            entry->node = input_new_node();
+            input_manager.nodes[node].num_children++;
+            created[num_created++] = entry;
+
+            if (node == INPUT_DEFAULT_MODE) {
+                for (int i = 0; i < input_manager.num_lock_masks; i++) {
+                    XGrabKey(wm.display, keycode, modifiers | input_manager.lock_masks[i],
+                             wm.root, True, GrabModeAsync, GrabModeAsync);
+                }
+            }
+        } else if (input_manager.nodes[entry->node].binding >= 0) {
+            LOG_WARN("Key sequence for '%s' conflicts with '%s', keeping the earlier binding",
+                     bind->action->name,
+                     input_manager.keybinds[input_manager.nodes[entry->node].binding].action->name);
+            input_keymap_rollback(created, num_created);
+            return;
+        } else if (last) {
+            LOG_WARN("Key sequence for '%s' is a prefix of another binding, ignoring it",
+                     bind->action->name);
+            input_keymap_rollback(created, num_created);
+            return;
+        }
+
+        node = entry->node;
+        if (last)
+            input_manager.nodes[node].binding = index;
+    }
+}
+
+/*
+ * Compile the bindings into the trie against the current keymap and regrab
+ * the chord prefixes. Call after the keymap or modifier mapping changed
+ * (MappingNotify); the grabs are only buffered here and go out to the
+ * server in a single flush.
+ */
+void input_rebuild_keymap(void) {
+    XUngrabKey(wm.display, AnyKey, AnyModifier, wm.root);
+    memset(input_manager.keymap, 0, sizeof(input_manager.keymap));
+    input_compute_lock_masks();
+    input_compute_modifier_keycodes();
+
+    input_manager.num_nodes = 0;
+    for (int i = 0; i < input_manager.num_modes; i++)
+        input_new_node();
+    for (int i = 0; i < input_manager.num_keybinds; i++)
+        input_keymap_insert(i);
+
+    input_set_mode(INPUT_DEFAULT_MODE);
+    XFlush(wm.display);
+}
+
+/* -- Dispatch -- */
+
+static void input_grab_keyboard(Time time) {
+    if (input_manager.keyboard_grabbed)
+        return;
+    if (X_ROUND_TRIP(XGrabKeyboard(wm.display, wm.root, True, GrabModeAsync, GrabModeAsync,
+                                   time)) == GrabSuccess)
+        input_manager.keyboard_grabbed = true;
+    else
+        LOG_WARN("Cannot grab the keyboard for a key sequence");
+}
+
+static void input_ungrab_keyboard(void) {
+    if (!input_manager.keyboard_grabbed)
+        return;
+    XUngrabKeyboard(wm.display, CurrentTime);
+    input_manager.keyboard_grabbed = false;
+}
+
+/* Switch modes; every mode but the default one holds the keyboard */
+void input_set_mode(int mode) {
+    if (mode < 0 || mode >= input_manager.num_modes)
+        mode = INPUT_DEFAULT_MODE;
+
+    input_manager.mode = mode;
+    input_manager.current = mode;
+    if (mode == INPUT_DEFAULT_MODE)
+        input_ungrab_keyboard();
+    else
+        input_grab_keyboard(CurrentTime);
+}
+
 void input_manager_init(void) {
     input_manager.capacity = 32;
     input_manager.keybinds = malloc(sizeof(Keybind) * input_manager.capacity);
     input_manager.num_keybinds = 0;
+    input_manager.modes[INPUT_DEFAULT_MODE] = "default";
+    input_manager.num_modes = 1;
     input_manager.mouse_dragging = false;
     
-    // Initialize XIM
-    input_manager.xim = XOpenIM(wm.display, NULL, NULL, NULL);
-    if (input_manager.xim) {
-        input_manager.xic = XCreateIC(input_manager.xim,
-                                    XNInputStyle,
-                                    XIMPreeditNothing | XIMStatusNothing,
-                                    XNClientWindow, wm.root,
-                                    XNFocusWindow, wm.root,
-                                    NULL);
-    }
+    // The input method is opened separately, see input_method_open()
     
-    // Register default keybindings
-    input_register_keybind(XK_F11, Mod1Mask, client_focus_next);     // Alt+F11
-    input_register_keybind(XK_Tab, Mod1Mask, client_cycle_focus);    // Alt+Tab
-    input_register_keybind(XK_q, Mod1Mask | ShiftMask, client_close_focused); // Alt+Shift+Q
-    input_register_keybind(XK_f, Mod1Mask, client_toggle_fullscreen_focused); // Alt+F
+    // Register keybindings from the config (defaults: Alt+F11, Alt+Tab,
+    // Alt+Shift+Q, Alt+F)
+    input_apply_keybinds();
+}
+
+/*
+ * Open the input method and its input context. Talking to the IM server can
+ * take a while, so this may run on a worker thread (the display is opened
+ * after XInitThreads); input_method_publish() then hands the result over.
+ */
+InputMethod *input_method_open(void) {
+    InputMethod *im = calloc(1, sizeof(*im));
+    if (!im) return NULL;
+
+    im->xim = XOpenIM(wm.display, NULL, NULL, NULL);
+    if (im->xim) {
+        im->xic = XCreateIC(im->xim,
+                            XNInputStyle,
+                            XIMPreeditNothing | XIMStatusNothing,
+                            XNClientWindow, wm.root,
+                            XNFocusWindow, wm.root,
+                            NULL);
+    }
+    return im;
+}
+
+/* Main thread only */
+void input_method_publish(InputMethod *im) {
+    if (!im) return;
+    input_manager.xim = im->xim;
+    input_manager.xic = im->xic;
+    free(im);
+}
+
+/* Drop the current keybindings and compile the ones from the config */
+void input_apply_keybinds(void) {
+    input_free_keybinds();
+
+    // Register every mode first so "mode <name>" can refer to modes
+    // declared further down in the file
+    for (int i = 0; i < config.keybinds.count; i++) {
+        if (config.keybinds.binds[i].mode)
+            input_add_mode(config.keybinds.binds[i].mode);
+    }
+
+    for (int i = 0; i < config.keybinds.count; i++) {
+        const KeybindConfig *conf = &config.keybinds.binds[i];
+
+        if (input_manager.num_keybinds >= input_manager.capacity) {
+            input_manager.capacity *= 2;
+            input_manager.keybinds = realloc(input_manager.keybinds,
+                                           sizeof(Keybind) * input_manager.capacity);
+        }
+        Keybind *bind = &input_manager.keybinds[input_manager.num_keybinds];
+
+        bind->mode = input_find_mode(conf->mode);
+        if (bind->mode < 0)
+            continue;
+        if (!input_parse_action(conf->action, bind)) {
+            LOG_WARN("Unknown keybinding action '%s'", conf->action);
+            continue;
+        }
+        if (!input_parse_sequence(conf->keys, bind)) {
+            LOG_WARN("Invalid key sequence '%s' for '%s'", conf->keys, conf->action);
+            free(bind->arg.str);
+            continue;
+        }
+        input_manager.num_keybinds++;
+    }
+    input_rebuild_keymap();
 }
 
 void input_manager_cleanup(void) {
+    input_ungrab_keyboard();
+    input_free_keybinds();
     if (input_manager.keybinds) {
         free(input_manager.keybinds);
         input_manager.keybinds = NULL;
     }
+    free(input_manager.nodes);
+    input_manager.nodes = NULL;
+    input_manager.nodes_capacity = 0;
     
     if (input_manager.xic) {
         XDestroyIC(input_manager.xic);
@@ -48,17 +522,44 @@ void input_manager_cleanup(void) {
     }
 }
 
+/*
+ * Advance the trie by one key. A leaf runs its action and returns to the
+ * mode root; a prefix holds the keyboard until the sequence completes or a
+ * key that continues no sequence cancels it.
+ */
 void input_handle_key(XEvent *ev) {
     XKeyEvent *key_ev = &ev->xkey;
-    KeySym keysym = XkbKeycodeToKeysym(wm.display, key_ev->keycode, 0, 0);
-    
-    for (int i = 0; i < input_manager.num_keybinds; i++) {
-        if (input_manager.keybinds[i].key == keysym &&
-            input_manager.keybinds[i].modifiers == key_ev->state) {
-            input_manager.keybinds[i].callback();
-            break;
-        }
+
+    // Pressing Shift or Alt mid-sequence only prepares the next step
+    if (input_manager.modifier_keycodes[key_ev->keycode & 0xff])
+        return;
+
+    int root = input_manager.mode;
+    KeymapEntry *entry = input_keymap_lookup(input_manager.current, key_ev->keycode,
+                                             input_clean_mask(key_ev->state));
+
+    if (!entry || entry->keycode == 0) {
+        input_manager.current = root;
+        if (root == INPUT_DEFAULT_MODE)
+            input_ungrab_keyboard();
+        else if (XLookupKeysym(key_ev, 0) == XK_Escape)
+            input_set_mode(INPUT_DEFAULT_MODE);
+        return;
+    }
+
+    const KeyNode *node = &input_manager.nodes[entry->node];
+    if (node->binding < 0) {
+        input_manager.current = entry->node;
+        input_grab_keyboard(key_ev->time);
+        return;
     }
+
+    input_manager.current = root;
+    if (root == INPUT_DEFAULT_MODE)
+        input_ungrab_keyboard();
+
+    const Keybind *bind = &input_manager.keybinds[node->binding];
+    bind->action->callback(&bind->arg);
 }
 
 void input_handle_button(XEvent *ev) {
@@ -68,10 +569,12 @@ void input_handle_button(XEvent *ev) {
     
     if (button_ev->button == Button1 && button_ev->state & Mod1Mask) {
         input_manager.mouse_dragging = true;
-        input_manager.drag_window = button_ev->subwindow;
         input_manager.drag_start_x = button_ev->x_root;
         input_manager.drag_start_y = button_ev->y_root;
         XRaiseWindow(wm.display, button_ev->subwindow);
+        Client *c = client_find_by_window(button_ev->subwindow);
+        input_manager.drag_client = c ? client_handle(c) : CLIENT_HANDLE_NONE;
+        if (c) ewmh_client_raised(c->window);
     }
 }
 
@@ -83,31 +586,11 @@ void input_handle_motion(XEvent *ev) {
     int dx = motion->x_root - input_manager.drag_start_x;
     int dy = motion->y_root - input_manager.drag_start_y;
     
-    Client *c = client_find_by_window(input_manager.drag_window);
+    // Resolves to NULL once the client is gone, even if its slot was reused
+    Client *c = client_from_handle(input_manager.drag_client);
     if (c) {
-        client_move(c, c->x + dx, c->y + dy);
+        client_move(c, CLIENT_X(c) + dx, CLIENT_Y(c) + dy);
         input_manager.drag_start_x = motion->x_root;
         input_manager.drag_start_y = motion->y_root;
     }
 }
-
-void input_register_keybind(KeySym key, unsigned int modifiers, void (*callback)(void)) {
-    if (input_manager.num_keybinds >= input_manager.capacity) {
-        input_manager.capacity *= 2;
-        input_manager.keybinds = realloc(input_manager.keybinds,
-                                       sizeof(Keybind) * input_manager.capacity);
-    }
-    
-    input_manager.keybinds[input_manager.num_keybinds].key = key;
-    input_manager.keybinds[input_manager.num_keybinds].modifiers = modifiers;
-    input_manager.keybinds[input_manager.num_keybinds].callback = callback;
-    input_manager.num_keybinds++;
-    
-    XGrabKey(wm.display,
-            XKeysymToKeycode(wm.display, key),
-            modifiers,
-            wm.root,
-            True,
-            GrabModeAsync,
-            GrabModeAsync);
-}
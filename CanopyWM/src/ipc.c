@@ -0,0 +1,439 @@
+// src/ipc.c
+#include "ipc.h"
+#include "client.h"
+#include "config.h"
+#include "event_loop.h"
+#include "wm.h"
+#include "ping.h"
+#include "xstats.h"
+#include "log.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define IPC_TITLE_MAX 512
+
+typedef struct {
+    int fd;                        // -1 for a free slot
+    uint32_t mask;                 // Subscribed event types, 0 if none
+    bool paused;                   // Not read until its replies have drained
+    char in[sizeof(IpcHeader) + IPC_MAX_PAYLOAD];
+    size_t in_len;
+    char *out;                     // IPC_OUT_BUFFER bytes
+    size_t out_start;
+    size_t out_len;
+    uint32_t dropped;              // Events lost since the last gap marker
+} IpcConn;
+
+static struct {
+    int listen_fd;
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    IpcConn clients[IPC_MAX_CLIENTS];
+    uint32_t subscribed;           // Union of the subscriber masks
+
+    // Events of the current main loop iteration, encoded as IpcEvent + title
+    char *batch;
+    size_t batch_len;
+    size_t batch_cap;
+    uint32_t batch_count;
+
+    uint64_t commands;
+    uint64_t events_sent;
+    uint64_t events_dropped;
+    uint64_t gaps;
+} ipc = { .listen_fd = -1 };
+
+static void handle_readable(int fd, void *data);
+
+static void update_subscribed(void) {
+    ipc.subscribed = 0;
+    for (int i = 0; i < IPC_MAX_CLIENTS; i++) {
+        if (ipc.clients[i].fd >= 0)
+            ipc.subscribed |= ipc.clients[i].mask;
+    }
+}
+
+static void conn_close(IpcConn *c) {
+    if (!c->paused)
+        event_loop_remove_fd(c->fd);
+    close(c->fd);
+    free(c->out);
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+    update_subscribed();
+}
+
+/* Append one message if it fits in limit bytes of out buffer */
+static bool conn_queue(IpcConn *c, uint16_t type, const void *payload, size_t len,
+                         size_t limit) {
+    size_t needed = sizeof(IpcHeader) + len;
+    if (c->out_len + needed > limit)
+        return false;
+    if (c->out_start + c->out_len + needed > IPC_OUT_BUFFER) {
+        memmove(c->out, c->out + c->out_start, c->out_len);
+        c->out_start = 0;
+    }
+
+    IpcHeader header = { .length = len, .type = type };
+    char *dst = c->out + c->out_start + c->out_len;
+    memcpy(dst, &header, sizeof(header));
+    if (len) memcpy(dst + sizeof(header), payload, len);
+    c->out_len += needed;
+    return true;
+}
+
+/* Write as much as the socket takes; never blocks */
+static bool conn_write(IpcConn *c) {
+    while (c->out_len > 0) {
+        ssize_t n = send(c->fd, c->out + c->out_start, c->out_len,
+                         MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            conn_close(c);
+            return false;
+        }
+        c->out_start += n;
+        c->out_len -= n;
+    }
+    if (c->out_len == 0)
+        c->out_start = 0;
+    return true;
+}
+
+_Static_assert(PING_BUCKETS == IPC_PING_BUCKETS, "ping histogram layout");
+
+static int32_t run_command(IpcConn *c, const IpcHeader *header, const char *payload) {
+    switch (header->type) {
+    case IPC_MSG_FOCUS:
+    case IPC_MSG_CLOSE: {
+        IpcWindowArg arg;
+        if (header->length != sizeof(arg)) return IPC_ERR_MALFORMED;
+        memcpy(&arg, payload, sizeof(arg));
+        Client *client = client_find_by_window(arg.window);
+        if (!client) return IPC_ERR_NO_WINDOW;
+        if (header->type == IPC_MSG_FOCUS)
+            client_focus(client);
+        else
+            client_close(client);
+        return IPC_OK;
+    }
+    case IPC_MSG_MOVE: {
+        IpcMoveArg arg;
+        if (header->length != sizeof(arg)) return IPC_ERR_MALFORMED;
+        memcpy(&arg, payload, sizeof(arg));
+        Client *client = client_find_by_window(arg.window);
+        if (!client) return IPC_ERR_NO_WINDOW;
+        if (!client_is_fullscreen(client))
+            client_move(client, arg.x, arg.y);
+        return IPC_OK;
+    }
+    case IPC_MSG_WORKSPACE:
+        return IPC_ERR_UNSUPPORTED;    // No workspaces yet
+    case IPC_MSG_RELOAD: {
+        unsigned int changed = config_reload();
+        if (changed)
+            wm_apply_config(changed);
+        return IPC_OK;
+    }
+    case IPC_MSG_SUBSCRIBE: {
+        if (header->length != sizeof(uint32_t)) return IPC_ERR_MALFORMED;
+        memcpy(&c->mask, payload, sizeof(c->mask));
+        c->dropped = 0;
+        update_subscribed();
+        return IPC_OK;
+    }
+    case IPC_MSG_XSTATS: {
+        IpcXStats records[XSTATS_SOURCES];
+        uint32_t count = 0;
+        for (int i = 0; i < XSTATS_SOURCES; i++) {
+            const XStatsSource *s = xstats_source(i);
+            if (s->count == 0)
+                continue;
+            IpcXStats *r = &records[count++];
+            memset(r, 0, sizeof(*r));
+            r->source = i;
+            char buf[sizeof(r->name)];
+            snprintf(r->name, sizeof(r->name), "%s", xstats_source_name(i, buf, sizeof(buf)));
+            r->count = s->count;
+            r->requests = s->requests;
+            r->round_trips = s->round_trips;
+        }
+        // Leave room for the reply that follows
+        if (!conn_queue(c, IPC_MSG_XSTATS_DATA, records, count * sizeof(*records),
+                        IPC_OUT_BUFFER - sizeof(IpcHeader) - sizeof(int32_t)))
+            return IPC_ERR_BUSY;
+        return IPC_OK;
+    }
+    case IPC_MSG_PING_STATS: {
+        IpcPingStats records[PING_MAX_APPS];
+        int count = ping_app_count();
+        for (int i = 0; i < count; i++) {
+            const PingAppStats *app = ping_app(i);
+            IpcPingStats *r = &records[i];
+            memset(r, 0, sizeof(*r));
+            snprintf(r->app, sizeof(r->app), "%s", app->app);
+            r->replies = app->replies;
+            r->timeouts = app->timeouts;
+            r->max_ms = (uint32_t)app->max_ms;
+            for (int b = 0; b < PING_BUCKETS; b++)
+                r->buckets[b] = app->buckets[b];
+        }
+        if (!conn_queue(c, IPC_MSG_PING_STATS_DATA, records, count * sizeof(*records),
+                        IPC_OUT_BUFFER - sizeof(IpcHeader) - sizeof(int32_t)))
+            return IPC_ERR_BUSY;
+        return IPC_OK;
+    }
+    default:
+        return IPC_ERR_UNKNOWN;
+    }
+}
+
+/* Run every complete command; stops while there is no room for the replies */
+static void conn_process(IpcConn *c) {
+    size_t pos = 0;
+    while (c->in_len - pos >= sizeof(IpcHeader)) {
+        IpcHeader header;
+        memcpy(&header, c->in + pos, sizeof(header));
+        if (header.length > IPC_MAX_PAYLOAD) {
+            LOG_WARN("IPC client sent an oversized message, disconnecting it.");
+            conn_close(c);
+            return;
+        }
+        if (c->in_len - pos < sizeof(header) + header.length)
+            break;
+        if (IPC_OUT_BUFFER - c->out_len < sizeof(IpcHeader) + sizeof(int32_t)) {
+            // Backpressure on commands: stop reading until the client reads
+            if (!c->paused) {
+                event_loop_remove_fd(c->fd);
+                c->paused = true;
+            }
+            break;
+        }
+
+        xstats_begin(XSTATS_SOURCE_IPC);
+        int32_t status = run_command(c, &header, c->in + pos + sizeof(header));
+        xstats_end();
+        conn_queue(c, IPC_MSG_REPLY, &status, sizeof(status), IPC_OUT_BUFFER);
+        ipc.commands++;
+        pos += sizeof(header) + header.length;
+    }
+    memmove(c->in, c->in + pos, c->in_len - pos);
+    c->in_len -= pos;
+}
+
+/*
+ * Flush replies. A paused connection resumes once they have all drained,
+ * which runs the commands it had already buffered; their replies may pause
+ * it again or drain as well, so repeat until neither happens.
+ */
+static void conn_drain(IpcConn *c) {
+    while (c->fd >= 0 && conn_write(c) && c->paused && c->out_len == 0) {
+        c->paused = false;
+        if (!event_loop_add_fd(c->fd, handle_readable, c)) {
+            conn_close(c);
+            return;
+        }
+        conn_process(c);
+    }
+}
+
+static void handle_readable(int fd, void *data) {
+    IpcConn *c = data;
+    ssize_t n = recv(fd, c->in + c->in_len, sizeof(c->in) - c->in_len, MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+        conn_close(c);
+        return;
+    }
+    if (n > 0)
+        c->in_len += n;
+
+    conn_process(c);
+    conn_drain(c);
+}
+
+static void handle_accept(int fd, void *data) {
+    (void)data;
+    int conn = accept4(fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (conn < 0)
+        return;
+
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0 || cred.uid != getuid()) {
+        close(conn);
+        return;
+    }
+
+    for (int i = 0; i < IPC_MAX_CLIENTS; i++) {
+        IpcConn *c = &ipc.clients[i];
+        if (c->fd >= 0)
+            continue;
+        c->out = malloc(IPC_OUT_BUFFER);
+        if (!c->out || !event_loop_add_fd(conn, handle_readable, c)) {
+            free(c->out);
+            c->out = NULL;
+            break;
+        }
+        c->fd = conn;
+        return;
+    }
+    LOG_WARN("Too many IPC clients, refusing a connection.");
+    close(conn);
+}
+
+bool ipc_init(void) {
+    for (int i = 0; i < IPC_MAX_CLIENTS; i++)
+        ipc.clients[i].fd = -1;
+
+    ipc_socket_path(ipc.path, sizeof(ipc.path));
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", ipc.path);
+
+    ipc.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (ipc.listen_fd < 0) {
+        LOG_WARN("Cannot create the IPC socket: %s", strerror(errno));
+        return false;
+    }
+
+    // Never take the socket over from another running instance
+    if (connect(ipc.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        LOG_WARN("Another CanopyWM is listening on %s, IPC disabled.", ipc.path);
+        close(ipc.listen_fd);
+        ipc.listen_fd = -1;
+        ipc.path[0] = '\0';
+        return false;
+    }
+    close(ipc.listen_fd);
+    ipc.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+
+    unlink(ipc.path);
+    if (ipc.listen_fd < 0 || bind(ipc.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        chmod(ipc.path, 0600) < 0 || listen(ipc.listen_fd, 8) < 0 ||
+        !event_loop_add_fd(ipc.listen_fd, handle_accept, NULL)) {
+        LOG_WARN("Cannot listen on %s: %s", ipc.path, strerror(errno));
+        ipc_cleanup();
+        return false;
+    }
+
+    setenv(CANOPY_SOCKET_ENV, ipc.path, 1);
+    LOG_INFO("Listening for IPC on %s", ipc.path);
+    return true;
+}
+
+void ipc_cleanup(void) {
+    for (int i = 0; i < IPC_MAX_CLIENTS; i++) {
+        if (ipc.clients[i].fd >= 0)
+            conn_close(&ipc.clients[i]);
+    }
+    if (ipc.listen_fd >= 0) {
+        event_loop_remove_fd(ipc.listen_fd);
+        close(ipc.listen_fd);
+        ipc.listen_fd = -1;
+        unlink(ipc.path);
+    }
+    free(ipc.batch);
+    ipc.batch = NULL;
+    ipc.batch_len = ipc.batch_cap = 0;
+    ipc.batch_count = 0;
+}
+
+void ipc_publish(uint32_t type, Window window, uint32_t value, const char *title) {
+    if (!(ipc.subscribed & IPC_EVENT_MASK(type)))
+        return;
+
+    size_t len = title ? strlen(title) : 0;
+    if (len > IPC_TITLE_MAX) {
+        len = IPC_TITLE_MAX;
+        while (len > 0 && ((unsigned char)title[len] & 0xc0) == 0x80)
+            len--;
+    }
+
+    size_t needed = sizeof(IpcEvent) + len;
+    if (ipc.batch_len + needed > ipc.batch_cap) {
+        size_t cap = ipc.batch_cap ? ipc.batch_cap * 2 : 4096;
+        while (cap < ipc.batch_len + needed)
+            cap *= 2;
+        char *batch = realloc(ipc.batch, cap);
+        if (!batch)
+            return;
+        ipc.batch = batch;
+        ipc.batch_cap = cap;
+    }
+
+    IpcEvent ev = { .type = type, .title_len = len, .window = window, .value = value };
+    memcpy(ipc.batch + ipc.batch_len, &ev, sizeof(ev));
+    if (len) memcpy(ipc.batch + ipc.batch_len + sizeof(ev), title, len);
+    ipc.batch_len += needed;
+    ipc.batch_count++;
+}
+
+/* Queue the events of this batch that c subscribed to, or count them as dropped */
+static void conn_queue_batch(IpcConn *c, char *scratch) {
+    size_t len = 0;
+    uint32_t count = 0;
+    for (size_t pos = 0; pos < ipc.batch_len; ) {
+        IpcEvent ev;
+        memcpy(&ev, ipc.batch + pos, sizeof(ev));
+        size_t size = sizeof(ev) + ev.title_len;
+        if (c->mask & IPC_EVENT_MASK(ev.type)) {
+            memcpy(scratch + len, ipc.batch + pos, size);
+            len += size;
+            count++;
+        }
+        pos += size;
+    }
+    if (count == 0)
+        return;
+
+    size_t limit = IPC_OUT_BUFFER - IPC_REPLY_RESERVE;
+    size_t gap_size = c->dropped ? sizeof(IpcHeader) + sizeof(uint32_t) : 0;
+    if (c->out_len + gap_size + sizeof(IpcHeader) + len > limit) {
+        c->dropped += count;
+        ipc.events_dropped += count;
+        return;
+    }
+    if (c->dropped) {
+        conn_queue(c, IPC_MSG_GAP, &c->dropped, sizeof(c->dropped), limit);
+        c->dropped = 0;
+        ipc.gaps++;
+    }
+    conn_queue(c, IPC_MSG_EVENTS, scratch, len, limit);
+    ipc.events_sent += count;
+}
+
+void ipc_flush(void) {
+    if (ipc.batch_count > 0) {
+        char *scratch = malloc(ipc.batch_len);
+        for (int i = 0; scratch && i < IPC_MAX_CLIENTS; i++) {
+            IpcConn *c = &ipc.clients[i];
+            if (c->fd >= 0 && c->mask)
+                conn_queue_batch(c, scratch);
+        }
+        free(scratch);
+        ipc.batch_len = 0;
+        ipc.batch_count = 0;
+    }
+
+    for (int i = 0; i < IPC_MAX_CLIENTS; i++) {
+        IpcConn *c = &ipc.clients[i];
+        if (c->fd >= 0 && (c->out_len > 0 || c->paused))
+            conn_drain(c);
+    }
+}
+
+void ipc_dump_stats(void) {
+    int connected = 0;
+    for (int i = 0; i < IPC_MAX_CLIENTS; i++) {
+        if (ipc.clients[i].fd >= 0)
+            connected++;
+    }
+    LOG_INFO("IPC: %d clients, %llu commands, %llu events sent, %llu dropped in %llu gaps",
+             connected, (unsigned long long)ipc.commands,
+             (unsigned long long)ipc.events_sent, (unsigned long long)ipc.events_dropped,
+             (unsigned long long)ipc.gaps);
+}
@@ -6,14 +6,29 @@
 #include "input.h"
 #include "notifications.h"
 #include "config.h"
+#include "cpu_policy.h"
+#include "event_loop.h"
+#include "event_batch.h"
+#include "wm_interface.h"
+#include "trace.h"
+#include "worker_pool.h"
+#include "de_supervisor.h"
+#include "restart.h"
+#include "wm_events.h"
+#include "ipc.h"
+#include "ewmh.h"
+#include "ping.h"
+#include "xerror.h"
+#include "xstats.h"
 #include "log.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
-#include <sys/select.h>
 #include <sys/wait.h>
+#include <poll.h>
+#include <errno.h>
 #include <unistd.h>
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
@@ -23,10 +38,16 @@
 #include <math.h>
 #include <time.h>
 
+// Give up waiting for the DE's ready message after this long
+#define DE_READY_TIMEOUT 30
+
+// Give up waiting for a nested X server to report its display after this long
+#define NESTED_SERVER_TIMEOUT_MS 10000
+
 // Global state
 static volatile sig_atomic_t running = 1;
-static pid_t xephyr_pid = -1;
-static pid_t de_pid = -1;
+static volatile sig_atomic_t dump_stats = 0;
+static pid_t nested_server_pid = -1;   // Xephyr or Xvfb in --debug/--headless
 
 static struct {
     cairo_surface_t *surface;
@@ -49,17 +70,18 @@ static const char *default_de_paths[] = {
 
 // Function declarations
 static void signal_handler(int signum);
+static void stats_signal_handler(int signum);
 static void setup_signals(void);
 static void cleanup_children(void);
 static const char* find_desktop_environment(void);
-static bool start_desktop_environment(const char *de_path);
-static bool start_debug_session(void);
+static void end_session(void);
+static bool start_nested_server(bool headless);
 static void update_loading_animation(void);
 static void start_loading_animation(void);
 static void stop_loading_animation(void);
 static void print_usage(const char *program_name);
-void client_manager_init(Display *dpy);
-void client_manager_cleanup(Display *dpy);
+static double session_age(void);
+static void handle_de_ready(void);
 
 static void signal_handler(int signum) {
     (void)signum;
@@ -67,6 +89,11 @@ static void signal_handler(int signum) {
     LOG_INFO("Signal received, shutting down.");
 }
 
+static void stats_signal_handler(int signum) {
+    (void)signum;
+    dump_stats = 1;
+}
+
 static void setup_signals(void) {
     struct sigaction sa;
     sa.sa_handler = signal_handler;
@@ -76,29 +103,27 @@ static void setup_signals(void) {
     sigaction(SIGTERM, &sa, NULL);
     sigaction(SIGINT, &sa, NULL);
     sigaction(SIGHUP, &sa, NULL);
+
+    // SIGUSR1 dumps runtime statistics to the log
+    sa.sa_handler = stats_signal_handler;
+    sigaction(SIGUSR1, &sa, NULL);
     LOG_INFO("Signals set up.");
 }
 
+static void stop_nested_server(void) {
+    if (nested_server_pid > 0) {
+        kill(nested_server_pid, SIGTERM);
+        waitpid(nested_server_pid, NULL, 0);
+        // The server removes its own lock file on SIGTERM
+        LOG_INFO("Nested X server process %d terminated.", nested_server_pid);
+        nested_server_pid = -1;
+    }
+}
+
 static void cleanup_children(void) {
     LOG_INFO("Cleaning up child processes.");
-    if (de_pid > 0) {
-        kill(de_pid, SIGTERM);
-        waitpid(de_pid, NULL, 0);
-        LOG_INFO("Desktop environment process %d terminated.", de_pid);
-    }
-    if (xephyr_pid > 0) {
-        kill(xephyr_pid, SIGTERM);
-        waitpid(xephyr_pid, NULL, 0);
-        LOG_INFO("Xephyr process %d terminated.", xephyr_pid);
-
-        const char *display = getenv("DISPLAY");
-        if (display && display[0] == ':') {
-            char lockfile[256];
-            snprintf(lockfile, sizeof(lockfile), "/tmp/.X%s-lock", display + 1);
-            unlink(lockfile);
-            LOG_INFO("Removed lockfile %s.", lockfile);
-        }
-    }
+    de_supervisor_stop();
+    stop_nested_server();
 }
 
 static void start_loading_animation(void) {
@@ -187,6 +212,8 @@ static void update_loading_animation(void) {
 static void stop_loading_animation(void) {
     if (loading.cr) cairo_destroy(loading.cr);
     if (loading.surface) cairo_surface_destroy(loading.surface);
+    loading.cr = NULL;
+    loading.surface = NULL;
     loading.active = false;
     XClearWindow(wm.display, wm.root);
     XFlush(wm.display);
@@ -204,87 +231,218 @@ static const char* find_desktop_environment(void) {
     return NULL;
 }
 
-static bool start_desktop_environment(const char *de_path) {
-    LOG_INFO("Starting desktop environment: %s", de_path);
-    de_pid = fork();
-    if (de_pid == 0) {
-        execl(de_path, de_path, NULL);
-        LOG_ERROR("Failed to start desktop environment (%s).", de_path);
-        perror("execl");
-        exit(1);
-    } else if (de_pid < 0) {
-        LOG_ERROR("Fork failed when starting desktop environment.");
-        perror("fork");
-        return false;
-    }
-    return true;
+/* The DE exited cleanly: the user logged out */
+static void end_session(void) {
+    running = 0;
 }
 
-static bool start_debug_session(void) {
-    LOG_INFO("Starting debug session with Xephyr.");
-    for (int i = 0; i < 10; i++) {
-        char lockfile[32];
-        snprintf(lockfile, sizeof(lockfile), "/tmp/.X%d-lock", i);
-        unlink(lockfile);
+/*
+ * Start Xephyr (or Xvfb when headless) on a display of its own choosing.
+ * With -displayfd the server writes the display number to the pipe once it
+ * accepts connections, so there is no probing and no fixed wait.
+ */
+static bool start_nested_server(bool headless) {
+    LOG_INFO("Starting nested X server (%s).", headless ? "Xvfb" : "Xephyr");
+
+    int fds[2];
+    if (pipe(fds) < 0) {
+        LOG_ERROR("Cannot create the -displayfd pipe: %s", strerror(errno));
+        return false;
     }
 
-    for (int display_num = 1; display_num < 10; display_num++) {
-        char display_str[16];
-        snprintf(display_str, sizeof(display_str), ":%d", display_num);
-
-        Display *test = XOpenDisplay(display_str);
-        if (test) {
-            XCloseDisplay(test);
-            continue;
-        }
-
-        xephyr_pid = fork();
-        if (xephyr_pid == 0) {
-            char display_arg[16];
-            snprintf(display_arg, sizeof(display_arg), ":%d", display_num);
-
-            execlp("Xephyr", "Xephyr", 
-                   display_arg,
+    nested_server_pid = fork();
+    if (nested_server_pid == 0) {
+        close(fds[0]);
+        char displayfd[16];
+        snprintf(displayfd, sizeof(displayfd), "%d", fds[1]);
+
+        if (headless) {
+            execlp("Xvfb", "Xvfb",
+                   "-displayfd", displayfd,
+                   "-screen", "0", "1920x1080x24",
+                   "-nolisten", "tcp",
+                   NULL);
+        } else {
+            execlp("Xephyr", "Xephyr",
+                   "-displayfd", displayfd,
                    "-ac",
                    "-screen", "1920x1080",
                    "-resizeable",
                    "-title", "CanopyWM [Debug Mode]",
                    NULL);
-            LOG_ERROR("Failed to start Xephyr.");
-            perror("execlp");
-            exit(1);
-        } else if (xephyr_pid < 0) {
-            LOG_ERROR("Fork failed when starting Xephyr.");
-            perror("fork");
-            return false;
         }
-
-        sleep(1);
-        setenv("DISPLAY", display_str, 1);
-        LOG_INFO("Debug session started on display %s.", display_str);
-        return true;
+        LOG_ERROR("Failed to start the nested X server.");
+        perror("execlp");
+        _exit(1);
+    } else if (nested_server_pid < 0) {
+        LOG_ERROR("Fork failed when starting the nested X server.");
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    close(fds[1]);
+
+    // Read "<display>\n"; EOF means the server died before it was ready
+    char buf[16];
+    size_t len = 0;
+    struct pollfd pfd = { .fd = fds[0], .events = POLLIN };
+    while (len < sizeof(buf) - 1 && !memchr(buf, '\n', len)) {
+        if (poll(&pfd, 1, NESTED_SERVER_TIMEOUT_MS) <= 0)
+            break;
+        ssize_t n = read(fds[0], buf + len, sizeof(buf) - 1 - len);
+        if (n <= 0)
+            break;
+        len += n;
+    }
+    close(fds[0]);
+    buf[len] = '\0';
+
+    char *end;
+    long display_num = strtol(buf, &end, 10);
+    if (len == 0 || end == buf || display_num < 0) {
+        LOG_ERROR("Nested X server did not report a display.");
+        stop_nested_server();   // Slow or broken; don't leave it holding a display
+        return false;
     }
 
-    LOG_ERROR("Could not find an available display for debug session.");
-    return false;
+    char display_str[16];
+    snprintf(display_str, sizeof(display_str), ":%ld", display_num);
+    setenv("DISPLAY", display_str, 1);
+    LOG_INFO("Nested X server ready on display %s.", display_str);
+    return true;
+}
+
+static double timespec_seconds(const struct timespec *ts) {
+    return ts->tv_sec + ts->tv_nsec / 1e9;
+}
+
+/*
+ * Seconds since this process was started by the login session. The kernel
+ * start time survives "exec canopy-wm" in .xinitrc or a session script, so
+ * this counts from the session launch rather than from main().
+ */
+static double session_age(void) {
+    FILE *f = fopen("/proc/self/stat", "r");
+    if (!f) return 0;
+
+    unsigned long long start_ticks = 0;
+    int matched = fscanf(f, "%*d (%*[^)]) %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+                            "%*u %*u %*d %*d %*d %*d %*d %*d %llu", &start_ticks);
+    fclose(f);
+    if (matched != 1) return 0;
+
+    struct timespec boot;
+    clock_gettime(CLOCK_BOOTTIME, &boot);
+    double age = timespec_seconds(&boot) - (double)start_ticks / sysconf(_SC_CLK_TCK);
+    return age > 0 ? age : 0;
+}
+
+// Login and WM start times, for reporting how long the desktop took to appear
+static double login_age_at_start;
+static struct timespec wm_start_time;
+
+/* The DE drew its first panel frame: drop the loading screen right away */
+static void handle_de_ready(void) {
+    trace_instant("de_ready");
+    loading.de_loaded = true;
+    stop_loading_animation();
+
+    struct timespec ready = wm_interface_de_ready_time();
+    double since_start = timespec_seconds(&ready) - timespec_seconds(&wm_start_time);
+    LOG_INFO("Desktop ready: %.3f s after login (%.3f s after CanopyWM started).",
+             login_age_at_start + since_start, since_start);
+}
+
+/* -- Startup tasks: run on the worker pool, published from the main loop -- */
+
+static void *load_audio(void *data) {
+    (void)data;
+    return audio_manager_load();
+}
+
+static void publish_audio(void *result) {
+    audio_manager_publish(result);
+}
+
+static void *load_system_bus(void *data) {
+    (void)data;
+    return wm_bus_connect();
+}
+
+static void publish_system_bus(void *result) {
+    wm_bus_publish(result);
+}
+
+static void *load_notifications(void *data) {
+    (void)data;
+    return notification_manager_connect() ? (void *)1 : NULL;
+}
+
+static void publish_notifications(void *result) {
+    notification_manager_publish(result != NULL);
+}
+
+static void *load_user_bus(void *data) {
+    (void)data;
+    return cpu_policy_connect();
+}
+
+static void publish_user_bus(void *result) {
+    cpu_policy_publish(result);
+}
+
+static void *load_input_method(void *data) {
+    (void)data;
+    return input_method_open();
+}
+
+static void publish_input_method(void *result) {
+    input_method_publish(result);
+}
+
+/*
+ * Subsystems that only need the X connection (or nothing at all) and spend
+ * their time waiting on ALSA, D-Bus or the IM server. None of them depends
+ * on another, and nothing on the critical path to the DE depends on them.
+ */
+static void submit_startup_tasks(void) {
+    worker_pool_submit("audio_manager_init", load_audio, publish_audio, NULL);
+    worker_pool_submit("system_bus_connect", load_system_bus, publish_system_bus, NULL);
+    worker_pool_submit("user_bus_connect", load_user_bus, publish_user_bus, NULL);
+    worker_pool_submit("notification_manager_init", load_notifications,
+                       publish_notifications, NULL);
+    worker_pool_submit("input_method_open", load_input_method, publish_input_method, NULL);
 }
 
 static void print_usage(const char *program_name) {
     printf("Usage: %s [OPTIONS]\n\n", program_name);
     printf("Options:\n");
     printf("  --debug            Run in debug mode with Xephyr\n");
+    printf("  --headless         Run on a nested Xvfb server, without a window\n");
     printf("  --de-path PATH     Specify path to desktop environment executable\n");
     printf("  --help             Show this help message\n");
 }
 
 int main(int argc, char *argv[]) {
     bool debug_mode = false;
+    bool headless = false;
     const char *de_path = NULL;
 
+    clock_gettime(CLOCK_MONOTONIC, &wm_start_time);
+    login_age_at_start = session_age();
+
+    // Must precede every other Xlib call: the input method is opened on
+    // a worker thread over the shared connection
+    XInitThreads();
+
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--debug") == 0) {
             debug_mode = true;
         }
+        else if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        }
         else if (strcmp(argv[i], "--de-path") == 0 && i + 1 < argc) {
             de_path = argv[++i];
         }
@@ -302,75 +460,124 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    if (debug_mode && !start_debug_session()) {
-        LOG_ERROR("Failed to start debug session.");
+    // Registered before any child exists so every exit path reaps them
+    atexit(cleanup_children);
+
+    // After a restart the nested server and the DE carry over from the old image
+    bool restoring = restart_load();
+    if (restoring) {
+        nested_server_pid = restart_state()->nested_server_pid;
+    } else if ((debug_mode || headless) && !start_nested_server(headless)) {
+        LOG_ERROR("Failed to start the nested X server.");
         return 1;
     }
-
+    restart_init(argv, nested_server_pid);
+
+    /*
+     * Init order follows the dependencies rather than the module list:
+     *
+     *   wm_init (X connection, root redirect)
+     *     -> wm_interface_init, loading screen -> spawn the DE
+     *     -> worker pool: audio, system bus, user bus, libnotify, input method
+     *     -> config_init -> wallpaper, clients, keybindings
+     *     -> display_manager_init (RandR)
+     *
+     * The DE only needs the redirect held to have its windows managed, so
+     * it starts before anything else; the worker results are published
+     * from the main loop as they arrive.
+     */
     LOG_INFO("Initializing subsystems...");
-    wm_init();
-    config_init();
-    client_manager_init(wm.display);
-    display_manager_init();
-    audio_manager_init();
-    input_manager_init();
-    notification_manager_init();
+    trace_init("CanopyWM", !restoring);
+    TRACE_PHASE("wm_init", wm_init());
+    wm_interface_init(wm.display);
 
     setup_signals();
-    atexit(cleanup_children);
 
-    start_loading_animation();
+    wm_events_init();
+    ipc_init();
 
-    if (!start_desktop_environment(de_path)) {
+    bool de_started;
+    if (restoring) {
+        loading.de_loaded = true;
+        de_started = de_supervisor_adopt(restart_state()->de_pid, de_path, end_session);
+    } else {
+        start_loading_animation();
+        TRACE_PHASE("start_desktop_environment",
+                    de_started = de_supervisor_start(de_path, end_session));
+    }
+    if (!de_started) {
         LOG_ERROR("Failed to start desktop environment.");
         stop_loading_animation();
         return 1;
     }
 
+    worker_pool_init();
+    submit_startup_tasks();
+
+    TRACE_PHASE("config_init", config_init());
+    TRACE_PHASE("wallpaper", wm_load_wallpaper(); wm_render_wallpaper());
+    TRACE_PHASE("client_manager_init", client_manager_init(wm.display));
+    TRACE_PHASE("input_manager_init", input_manager_init());
+    TRACE_PHASE("display_manager_init", display_manager_init());
+
     LOG_INFO("CanopyWM initialized and running.");
     time_t start_time = time(NULL);
 
     while (running) {
-        while (XPending(wm.display)) {
-            XEvent ev;
-            XNextEvent(wm.display, &ev);
+        event_batch_dispatch(wm.display);
 
-            wm_handle_event(&ev);
-        }
-
-        if (!loading.de_loaded && difftime(time(NULL), start_time) >= 5) {
+        if (!loading.de_loaded && wm_interface_is_de_ready()) {
+            handle_de_ready();
+        } else if (!loading.de_loaded && difftime(time(NULL), start_time) >= DE_READY_TIMEOUT) {
             loading.de_loaded = true;
-            LOG_INFO("Desktop environment marked as loaded.");
+            LOG_WARN("Desktop environment did not report ready within %d s.", DE_READY_TIMEOUT);
         }
 
         if (loading.active) update_loading_animation();
 
+        xstats_begin(XSTATS_SOURCE_LOOP);
         notification_clear_expired();
-
-        int status;
-        if (waitpid(de_pid, &status, WNOHANG) == de_pid) {
-            LOG_INFO("Desktop environment exited, shutting down.");
-            running = 0;
-            break;
+        xerror_flush();
+        client_flush_titles();
+        ping_tick();
+        cpu_policy_flush();
+        ewmh_flush();
+        notification_flush();
+        wm_events_flush();
+        xstats_end();
+        ipc_flush();    // Resumed commands are accounted to IPC, not the loop
+
+        if (dump_stats) {
+            dump_stats = 0;
+            notification_dump_stats();
+            ipc_dump_stats();
+            client_dump_stats();
+            xerror_dump_stats();
+            xstats_dump_stats();
+            event_loop_dump_stats();
+            event_batch_dump_stats();
+            ping_dump_stats();
+            cpu_policy_dump_stats();
         }
 
-        struct timeval tv = {0, 16666};
-        int xfd = ConnectionNumber(wm.display);
-        fd_set fds;
-        FD_ZERO(&fds);
-        FD_SET(xfd, &fds);
-        select(xfd + 1, &fds, NULL, NULL, &tv);
+        event_loop_wait(ConnectionNumber(wm.display), 16666);
     }
 
     LOG_INFO("Shutting down CanopyWM...");
+    worker_pool_cleanup();
     stop_loading_animation();
     notification_manager_cleanup();
     input_manager_cleanup();
     audio_manager_cleanup();
+    cpu_policy_cleanup();
     display_manager_cleanup();
     client_manager_cleanup(wm.display);
     config_cleanup();
+    wm_interface_cleanup();
+    ipc_cleanup();
+    wm_events_cleanup();
     wm_cleanup();
+    trace_close();
 
     LOG_INFO("Shutdown complete.");
     return 0;
@@ -0,0 +1,167 @@
+// src/notification_history.c
+#include "notification_history.h"
+#include "log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NOTIFICATION_HISTORY_SIZE \
+    (sizeof(NotificationHistoryHeader) + \
+     NOTIFICATION_HISTORY_SLOTS * sizeof(NotificationHistoryRecord))
+
+static struct {
+    NotificationHistoryHeader *header;
+    NotificationHistoryRecord *slots;
+} history;
+
+static bool history_state_dir(char *buf, size_t len) {
+    const char *state = getenv("XDG_STATE_HOME");
+    const char *home = getenv("HOME");
+    int n;
+
+    if (state && state[0] == '/')
+        n = snprintf(buf, len, "%s/canopy", state);
+    else if (home)
+        n = snprintf(buf, len, "%s/.local/state/canopy", home);
+    else
+        return false;
+    if (n < 0 || (size_t)n >= len)
+        return false;
+
+    // mkdir -p
+    for (char *p = buf + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        mkdir(buf, 0755);
+        *p = '/';
+    }
+    return mkdir(buf, 0755) == 0 || errno == EEXIST;
+}
+
+static bool history_header_valid(const NotificationHistoryHeader *header) {
+    return header->magic == NOTIFICATION_HISTORY_MAGIC &&
+           header->version == NOTIFICATION_HISTORY_VERSION &&
+           header->slot_count == NOTIFICATION_HISTORY_SLOTS &&
+           header->slot_size == sizeof(NotificationHistoryRecord);
+}
+
+/* Map the history ring, creating or resetting it if the layout changed. */
+bool notification_history_open(void) {
+    char path[PATH_MAX];
+    if (!history_state_dir(path, sizeof(path) - sizeof(NOTIFICATION_HISTORY_FILE) - 1)) {
+        LOG_WARN("Notification history disabled: no state directory.");
+        return false;
+    }
+    strcat(path, "/" NOTIFICATION_HISTORY_FILE);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        LOG_WARN("Failed to open notification history %s: %s", path, strerror(errno));
+        return false;
+    }
+
+    // Only ever grow the file: CanopyDE may have it mapped, and shrinking it
+    // would turn the DE's reads past the new end into SIGBUS.
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        LOG_WARN("Failed to stat notification history: %s", strerror(errno));
+        close(fd);
+        return false;
+    }
+    if ((size_t)st.st_size < NOTIFICATION_HISTORY_SIZE &&
+        ftruncate(fd, NOTIFICATION_HISTORY_SIZE) < 0) {
+        LOG_WARN("Failed to size notification history: %s", strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    void *map = mmap(NULL, NOTIFICATION_HISTORY_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LOG_WARN("Failed to map notification history: %s", strerror(errno));
+        return false;
+    }
+
+    history.header = map;
+    history.slots = (NotificationHistoryRecord *)(history.header + 1);
+
+    // Reset an unknown layout in place. The magic is cleared first and
+    // written last so a reader never trusts a half-initialised header.
+    if (!history_header_valid(history.header)) {
+        history.header->magic = 0;
+        atomic_thread_fence(memory_order_release);
+        memset(history.slots, 0, NOTIFICATION_HISTORY_SLOTS * sizeof(NotificationHistoryRecord));
+        history.header->version = NOTIFICATION_HISTORY_VERSION;
+        history.header->slot_count = NOTIFICATION_HISTORY_SLOTS;
+        history.header->slot_size = sizeof(NotificationHistoryRecord);
+        atomic_store(&history.header->head, 0);
+        atomic_thread_fence(memory_order_release);
+        history.header->magic = NOTIFICATION_HISTORY_MAGIC;
+    }
+
+    LOG_INFO("Notification history %s (%llu records).", path,
+             (unsigned long long)atomic_load(&history.header->head));
+    return true;
+}
+
+void notification_history_close(void) {
+    if (history.header) {
+        munmap(history.header, NOTIFICATION_HISTORY_SIZE);
+        history.header = NULL;
+        history.slots = NULL;
+    }
+}
+
+/*
+ * Append a record by writing it straight into its slot in the mapping. The
+ * oldest record is overwritten once the ring is full.
+ */
+void notification_history_append(const char *app_name, const char *summary,
+                                 const char *body, unsigned int urgency) {
+    if (!history.header) return;
+
+    uint64_t n = atomic_load_explicit(&history.header->head, memory_order_relaxed) + 1;
+    NotificationHistoryRecord *slot = &history.slots[(n - 1) % NOTIFICATION_HISTORY_SLOTS];
+
+    atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->timestamp = time(NULL);
+    slot->urgency = urgency;
+    snprintf(slot->app_name, sizeof(slot->app_name), "%s", app_name ? app_name : "");
+    snprintf(slot->summary, sizeof(slot->summary), "%s", summary ? summary : "");
+    snprintf(slot->body, sizeof(slot->body), "%s", body ? body : "");
+
+    atomic_store_explicit(&slot->seq, n, memory_order_release);
+    atomic_store_explicit(&history.header->head, n, memory_order_release);
+}
+
+/*
+ * Copy up to max of app_name's newest records into out, newest first. The
+ * WM is the only writer, so its own reads cannot see a torn record.
+ */
+unsigned int notification_history_find_by_app(const char *app_name,
+                                               NotificationHistoryRecord *out,
+                                               unsigned int max) {
+    if (!history.header || !app_name) return 0;
+
+    uint64_t head = atomic_load_explicit(&history.header->head, memory_order_relaxed);
+    uint64_t oldest = head > NOTIFICATION_HISTORY_SLOTS ? head - NOTIFICATION_HISTORY_SLOTS : 0;
+    unsigned int count = 0;
+
+    for (uint64_t n = head; n > oldest && count < max; n--) {
+        const NotificationHistoryRecord *slot =
+            &history.slots[(n - 1) % NOTIFICATION_HISTORY_SLOTS];
+        if (strcmp(slot->app_name, app_name) == 0)
+            memcpy(&out[count++], slot, sizeof(*slot));
+    }
+    return count;
+}
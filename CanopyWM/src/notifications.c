@@ -1,75 +1,302 @@
-
 // src/notifications.c
 #include "notifications.h"
+#include "notification_history.h"
+#include "worker_pool.h"
+#include "log.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define NOTIFICATION_DEFAULT_APP "CanopyWM"
+
 // Global notification manager instance
 NotificationManager notification_manager;
 
-void notification_manager_init(void) {
+// D-Bus traffic for one notification_flush(), holding a reference to each popup
+typedef struct {
+    NotifyNotification *show[MAX_NOTIFICATIONS];
+    int num_show;
+    NotifyNotification *close[MAX_NOTIFICATIONS];
+    int num_close;
+} NotificationBatch;
+
+static double timespec_diff(const struct timespec *a, const struct timespec *b) {
+    return (double)(a->tv_sec - b->tv_sec) + (a->tv_nsec - b->tv_nsec) / 1e9;
+}
+
+/*
+ * Closing a popup is a D-Bus round trip, so it is left to the next flush.
+ * When too many are waiting the reference is just dropped and the daemon
+ * expires the popup on its own timeout.
+ */
+static void notification_entry_free(NotificationEntry *entry) {
+    if (entry->notification) {
+        if (notification_manager.num_retired < MAX_NOTIFICATIONS) {
+            notification_manager.retired[notification_manager.num_retired++] =
+                entry->notification;
+            notification_manager.layout_dirty = true;
+        } else {
+            g_object_unref(entry->notification);
+        }
+        entry->notification = NULL;
+    }
+    free(entry->app_name);
+    free(entry->summary);
+    free(entry->body);
+}
+
+// Remove the entry at index i, keeping the remaining entries in arrival order.
+static void notification_remove_at(int i) {
+    notification_entry_free(&notification_manager.entries[i]);
+    memmove(&notification_manager.entries[i],
+           &notification_manager.entries[i + 1],
+           (notification_manager.count - i - 1) * sizeof(NotificationEntry));
+    notification_manager.count--;
+}
+
+// Look up the sender's bucket, creating it (or recycling the least recently
+// active one when the table is full) on first use.
+static NotificationSender *notification_get_sender(const char *app_name,
+                                                   const struct timespec *now) {
+    NotificationSender *oldest = NULL;
+
+    for (int i = 0; i < notification_manager.num_senders; i++) {
+        NotificationSender *s = &notification_manager.senders[i];
+        if (strcmp(s->app_name, app_name) == 0)
+            return s;
+        if (!oldest || timespec_diff(&s->last_refill, &oldest->last_refill) < 0)
+            oldest = s;
+    }
+
+    NotificationSender *sender;
+    if (notification_manager.num_senders < MAX_NOTIFICATION_SENDERS) {
+        sender = &notification_manager.senders[notification_manager.num_senders++];
+    } else {
+        LOG_WARN("Notification sender table full, recycling stats of '%s'.",
+                 oldest->app_name);
+        sender = oldest;
+    }
+
+    memset(sender, 0, sizeof(*sender));
+    snprintf(sender->app_name, sizeof(sender->app_name), "%s", app_name);
+    sender->tokens = NOTIFICATION_RATE_BURST;
+    sender->last_refill = *now;
+    return sender;
+}
+
+// Refill the bucket for the time elapsed since the last call and try to take
+// one token from it.
+static bool notification_take_token(NotificationSender *sender,
+                                    const struct timespec *now) {
+    sender->tokens += timespec_diff(now, &sender->last_refill) * NOTIFICATION_RATE_PER_SEC;
+    if (sender->tokens > NOTIFICATION_RATE_BURST)
+        sender->tokens = NOTIFICATION_RATE_BURST;
+    sender->last_refill = *now;
+
+    if (sender->tokens < 1.0)
+        return false;
+    sender->tokens -= 1.0;
+    return true;
+}
+
+static NotificationEntry *notification_find_duplicate(const char *app_name,
+                                                      const char *summary,
+                                                      const char *body) {
+    for (int i = 0; i < notification_manager.count; i++) {
+        NotificationEntry *entry = &notification_manager.entries[i];
+        if (strcmp(entry->app_name, app_name) == 0 &&
+            strcmp(entry->summary, summary) == 0 &&
+            strcmp(entry->body, body) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/* Register with the notification daemon; safe to run on a worker thread */
+bool notification_manager_connect(void) {
     if (!notify_init("CanopyWM")) {
         fprintf(stderr, "Failed to initialize libnotify\n");
+        return false;
+    }
+    return true;
+}
+
+/* Start accepting notifications once connected; main thread only */
+void notification_manager_publish(bool connected) {
+    if (!connected) {
         return;
     }
-    
+
     notification_manager.count = 0;
+    notification_manager.num_senders = 0;
+    notification_manager.layout_dirty = false;
     notification_manager.initialized = true;
+
+    notification_history_open();
+}
+
+void notification_manager_init(void) {
+    notification_manager_publish(notification_manager_connect());
 }
 
 void notification_manager_cleanup(void) {
     for (int i = 0; i < notification_manager.count; i++) {
-        if (notification_manager.entries[i].notification) {
-            notify_notification_close(notification_manager.entries[i].notification, NULL);
-        }
-        free(notification_manager.entries[i].summary);
-        free(notification_manager.entries[i].body);
+        notification_entry_free(&notification_manager.entries[i]);
+    }
+
+    // The worker pool is gone by now, so close what is left synchronously
+    for (int i = 0; i < notification_manager.num_retired; i++) {
+        notify_notification_close(notification_manager.retired[i], NULL);
+        g_object_unref(notification_manager.retired[i]);
     }
-    
+    notification_manager.num_retired = 0;
     notification_manager.count = 0;
     notification_manager.initialized = false;
     notify_uninit();
+    notification_history_close();
 }
 
 void notification_show(const char *summary, const char *body, int timeout) {
-    if (!notification_manager.initialized || 
-        notification_manager.count >= MAX_NOTIFICATIONS) {
+    notification_show_from(NOTIFICATION_DEFAULT_APP, NOTIFY_URGENCY_NORMAL,
+                           summary, body, timeout);
+}
+
+/*
+ * Queue a notification on behalf of app_name. Identical notifications from
+ * the same sender are folded into the visible entry, everything else has to
+ * pass the sender's token bucket and is recorded in the persistent history
+ * ring. Nothing reaches the notification daemon until notification_flush()
+ * runs at the end of the frame.
+ */
+void notification_show_from(const char *app_name, NotifyUrgency urgency,
+                            const char *summary, const char *body, int timeout) {
+    if (!notification_manager.initialized) {
         return;
     }
-    
-    NotificationEntry *entry = &notification_manager.entries[notification_manager.count++];
-    
+    if (!app_name) app_name = NOTIFICATION_DEFAULT_APP;
+    if (!body) body = "";
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    NotificationSender *sender = notification_get_sender(app_name, &now);
+    sender->received++;
+
+    NotificationEntry *entry = notification_find_duplicate(app_name, summary, body);
+    if (entry) {
+        entry->count++;
+        entry->timestamp = time(NULL);
+        entry->timeout = timeout;
+        entry->dirty = true;
+        notification_manager.layout_dirty = true;
+        sender->coalesced++;
+        return;
+    }
+
+    if (!notification_take_token(sender, &now)) {
+        sender->dropped++;
+        return;
+    }
+
+    // Make room by retiring the oldest popup rather than refusing the new one.
+    if (notification_manager.count >= MAX_NOTIFICATIONS) {
+        notification_remove_at(0);
+    }
+
+    entry = &notification_manager.entries[notification_manager.count++];
+
     entry->notification = notify_notification_new(summary, body, NULL);
     notify_notification_set_timeout(entry->notification, timeout);
-    
+    notify_notification_set_urgency(entry->notification, urgency);
+
+    entry->app_name = strdup(app_name);
     entry->summary = strdup(summary);
     entry->body = strdup(body);
     entry->timestamp = time(NULL);
     entry->timeout = timeout;
-    
-    notify_notification_show(entry->notification, NULL);
+    entry->count = 1;
+    entry->dirty = true;
+
+    notification_manager.layout_dirty = true;
+    sender->shown++;
+
+    notification_history_append(app_name, summary, body, urgency);
+}
+
+/* Talk to the notification daemon; runs on a worker thread */
+static void *notification_flush_job(void *data) {
+    NotificationBatch *batch = data;
+    for (int i = 0; i < batch->num_close; i++)
+        notify_notification_close(batch->close[i], NULL);
+    for (int i = 0; i < batch->num_show; i++)
+        notify_notification_show(batch->show[i], NULL);
+    return batch;
+}
+
+static void notification_flush_done(void *result) {
+    NotificationBatch *batch = result;
+    for (int i = 0; i < batch->num_close; i++)
+        g_object_unref(batch->close[i]);
+    for (int i = 0; i < batch->num_show; i++)
+        g_object_unref(batch->show[i]);
+    free(batch);
+    notification_manager.flushing = false;
+}
+
+/*
+ * Push every entry that changed since the last frame to the notification
+ * daemon in one pass, so a burst of notifications costs one relayout of the
+ * popup stack instead of one per message. The D-Bus calls run on a worker;
+ * the popups are only modified here, and not while a flush is in flight.
+ */
+void notification_flush(void) {
+    if (!notification_manager.layout_dirty || notification_manager.flushing) {
+        return;
+    }
+
+    NotificationBatch *batch = malloc(sizeof(*batch));
+    if (!batch) {
+        return;     // Retried next frame
+    }
+    batch->num_show = 0;
+    batch->num_close = notification_manager.num_retired;
+    memcpy(batch->close, notification_manager.retired,
+           notification_manager.num_retired * sizeof(*batch->close));
+    notification_manager.num_retired = 0;
+
+    for (int i = 0; i < notification_manager.count; i++) {
+        NotificationEntry *entry = &notification_manager.entries[i];
+        if (!entry->dirty) continue;
+
+        if (entry->count > 1) {
+            char summary[256];
+            snprintf(summary, sizeof(summary), "%s (x%u)", entry->summary, entry->count);
+            notify_notification_update(entry->notification, summary, entry->body, NULL);
+            notify_notification_set_timeout(entry->notification, entry->timeout);
+        }
+        batch->show[batch->num_show++] = g_object_ref(entry->notification);
+        entry->dirty = false;
+    }
+
+    notification_manager.layout_dirty = false;
+    notification_manager.flushing = true;
+    if (!worker_pool_submit("notification_flush", notification_flush_job,
+                            notification_flush_done, batch)) {
+        notification_flush_done(notification_flush_job(batch));
+    }
 }
 
 void notification_clear_expired(void) {
     time_t current_time = time(NULL);
     int i = 0;
-    
+
     while (i < notification_manager.count) {
         NotificationEntry *entry = &notification_manager.entries[i];
-        
+
         if (current_time - entry->timestamp > entry->timeout / 1000) {
-            // Close and free notification
-            notify_notification_close(entry->notification, NULL);
-            free(entry->summary);
-            free(entry->body);
-            
-            // Move remaining notifications up
-            memmove(&notification_manager.entries[i],
-                   &notification_manager.entries[i + 1],
-                   (notification_manager.count - i - 1) * sizeof(NotificationEntry));
-            
-            notification_manager.count--;
+            // Close and free notification, moving remaining ones up
+            notification_remove_at(i);
         } else {
             i++;
         }
@@ -78,12 +305,18 @@ void notification_clear_expired(void) {
 
 void notification_clear_all(void) {
     for (int i = 0; i < notification_manager.count; i++) {
-        if (notification_manager.entries[i].notification) {
-            notify_notification_close(notification_manager.entries[i].notification, NULL);
-        }
-        free(notification_manager.entries[i].summary);
-        free(notification_manager.entries[i].body);
+        notification_entry_free(&notification_manager.entries[i]);
     }
-    
+
     notification_manager.count = 0;
-}
\ No newline at end of file
+}
+
+void notification_dump_stats(void) {
+    LOG_INFO("Notification stats (%d senders, %d visible):",
+             notification_manager.num_senders, notification_manager.count);
+    for (int i = 0; i < notification_manager.num_senders; i++) {
+        NotificationSender *s = &notification_manager.senders[i];
+        LOG_INFO("  %-24s received=%lu shown=%lu coalesced=%lu dropped=%lu",
+                 s->app_name, s->received, s->shown, s->coalesced, s->dropped);
+    }
+}
@@ -0,0 +1,155 @@
+// src/ping.c
+#include "ping.h"
+#include "wm.h"
+#include "wm_events.h"
+#include "xerror.h"
+#include "log.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static struct {
+    PingAppStats apps[PING_MAX_APPS];
+    int num_apps;
+    int outstanding;                   // Clients with a ping in flight
+} ping;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* Stats of the client's application, keyed by the class half of WM_CLASS */
+static PingAppStats *app_stats(Client *c) {
+    const PropValue *value = props_get(&c->props, c->window, PROP_WM_CLASS);
+    const char *name = "unknown";
+    if (value->data && value->format == 8) {
+        const char *instance = value->data;
+        size_t instance_len = strnlen(instance, value->items);
+        if (instance_len + 1 < value->items)
+            name = instance + instance_len + 1;
+    }
+
+    for (int i = 0; i < ping.num_apps; i++) {
+        if (strncmp(ping.apps[i].app, name, PING_APP_NAME - 1) == 0)
+            return &ping.apps[i];
+    }
+    if (ping.num_apps < PING_MAX_APPS - 1) {
+        PingAppStats *app = &ping.apps[ping.num_apps++];
+        memset(app, 0, sizeof(*app));
+        strncpy(app->app, name, PING_APP_NAME - 1);
+        return app;
+    }
+
+    // The last slot is kept for the applications that did not get their own
+    PingAppStats *other = &ping.apps[PING_MAX_APPS - 1];
+    if (ping.num_apps < PING_MAX_APPS) {
+        memset(other, 0, sizeof(*other));
+        strcpy(other->app, "other");
+        ping.num_apps = PING_MAX_APPS;
+    }
+    return other;
+}
+
+static void set_responding(Client *c, bool responding) {
+    c->not_responding = !responding;
+    client_draw_decorations(c);
+    wm_events_publish(WM_EVENT_CLIENT_NOT_RESPONDING, c->window, !responding, NULL);
+}
+
+void ping_client(Client *client) {
+    if (client->ping_token ||
+        !props_has_protocol(&client->props, client->window, wm.atoms[NET_WM_PING]))
+        return;
+
+    double now = now_ms();
+    // Our own clock stands in for the timestamp; the client only echoes it
+    long token = (long)((unsigned long)now & 0x7fffffff);
+    if (token == 0)
+        token = 1;
+
+    XEvent ev = { 0 };
+    ev.xclient.type = ClientMessage;
+    ev.xclient.window = client->window;
+    ev.xclient.message_type = wm.atoms[WM_PROTOCOLS];
+    ev.xclient.format = 32;
+    ev.xclient.data.l[0] = wm.atoms[NET_WM_PING];
+    ev.xclient.data.l[1] = token;
+    ev.xclient.data.l[2] = client->window;
+    xerror_mark(client);
+    XSendEvent(wm.display, client->window, False, NoEventMask, &ev);
+
+    client->ping_token = token;
+    client->ping_sent = now;
+    ping.outstanding++;
+}
+
+void ping_reply(Window window, long token) {
+    Client *c = client_find_by_window(window);
+    if (!c || !c->ping_token || c->ping_token != token)
+        return;
+
+    double latency = now_ms() - c->ping_sent;
+    PingAppStats *app = app_stats(c);
+    int bucket = 0;
+    while (bucket < PING_BUCKETS - 1 && latency >= (double)(1 << bucket))
+        bucket++;
+    app->buckets[bucket]++;
+    app->replies++;
+    if (latency > app->max_ms)
+        app->max_ms = latency;
+
+    c->ping_token = 0;
+    ping.outstanding--;
+    if (c->not_responding) {
+        LOG_INFO("Client 0x%lx (%s) is responding again after %.0f ms.",
+                 c->window, app->app, latency);
+        set_responding(c, true);
+    }
+}
+
+void ping_tick(void) {
+    double now = now_ms();
+    Client *focused = client_manager.focused;
+    if (focused && !focused->ping_token && now - focused->ping_sent >= PING_INTERVAL_MS)
+        ping_client(focused);
+    if (ping.outstanding == 0)
+        return;
+
+    // Recounted rather than decremented, as clients with a ping in flight may be removed
+    ping.outstanding = 0;
+    for (Client *c = client_first(); c; c = client_next(c)) {
+        if (!c->ping_token)
+            continue;
+        ping.outstanding++;
+        if (!c->not_responding && now - c->ping_sent >= PING_TIMEOUT_MS) {
+            PingAppStats *app = app_stats(c);
+            app->timeouts++;
+            LOG_WARN("Client 0x%lx (%s, pid %d) is not responding.",
+                     c->window, app->app, (int)props_pid(&c->props, c->window));
+            set_responding(c, false);
+        }
+    }
+}
+
+int ping_app_count(void) {
+    return ping.num_apps;
+}
+
+const PingAppStats *ping_app(int index) {
+    return index >= 0 && index < ping.num_apps ? &ping.apps[index] : NULL;
+}
+
+void ping_dump_stats(void) {
+    LOG_INFO("Ping reply latency per application:");
+    for (int i = 0; i < ping.num_apps; i++) {
+        const PingAppStats *app = &ping.apps[i];
+        char histogram[PING_BUCKETS * 12] = "";
+        size_t len = 0;
+        for (int b = 0; b < PING_BUCKETS && len < sizeof(histogram); b++)
+            len += snprintf(histogram + len, sizeof(histogram) - len, " %lu", app->buckets[b]);
+        LOG_INFO("  %-24s replies=%lu timeouts=%lu max=%.0f ms buckets:%s",
+                 app->app, app->replies, app->timeouts, app->max_ms, histogram);
+    }
+}
@@ -0,0 +1,176 @@
+// src/props.c
+#include "props.h"
+#include "wm.h"
+#include "xstats.h"
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Longest value read per slot, in 32-bit units
+static const uint32_t slot_max_length[PROP_COUNT] = {
+    [PROP_NET_WM_NAME] = 256,
+    [PROP_WM_NAME] = 256,
+    [PROP_WM_CLASS] = 64,
+    [PROP_WM_HINTS] = 9,
+    [PROP_WM_NORMAL_HINTS] = 18,
+    [PROP_WM_PROTOCOLS] = 16,
+    [PROP_NET_WM_WINDOW_TYPE] = 16,
+    [PROP_NET_WM_STATE] = 32,
+    [PROP_NET_WM_PID] = 1,
+    [PROP_WM_CLIENT_MACHINE] = 64,
+};
+
+static Atom slot_atom(int slot) {
+    switch (slot) {
+    case PROP_NET_WM_NAME: return wm.atoms[NET_WM_NAME];
+    case PROP_WM_NAME: return XA_WM_NAME;
+    case PROP_WM_CLASS: return XA_WM_CLASS;
+    case PROP_WM_HINTS: return XA_WM_HINTS;
+    case PROP_WM_NORMAL_HINTS: return XA_WM_NORMAL_HINTS;
+    case PROP_WM_PROTOCOLS: return wm.atoms[WM_PROTOCOLS];
+    case PROP_NET_WM_WINDOW_TYPE: return wm.atoms[NET_WM_WINDOW_TYPE];
+    case PROP_NET_WM_STATE: return wm.atoms[NET_WM_STATE];
+    case PROP_NET_WM_PID: return wm.atoms[NET_WM_PID];
+    case PROP_WM_CLIENT_MACHINE: return XA_WM_CLIENT_MACHINE;
+    default: return None;
+    }
+}
+
+static xcb_get_property_cookie_t request(xcb_connection_t *conn, Window window, int slot) {
+    return xcb_get_property(conn, 0, (xcb_window_t)window, (xcb_atom_t)slot_atom(slot),
+                            XCB_GET_PROPERTY_TYPE_ANY, 0, slot_max_length[slot]);
+}
+
+/* Take the reply into a slot; strings are NUL-terminated and cut at a UTF-8 boundary */
+static void store(PropValue *value, xcb_connection_t *conn, xcb_get_property_cookie_t cookie) {
+    xcb_generic_error_t *error = NULL;
+    xcb_get_property_reply_t *reply = xcb_get_property_reply(conn, cookie, &error);
+    free(error);
+
+    free(value->data);
+    memset(value, 0, sizeof(*value));
+    if (!reply || reply->type == XCB_NONE) {
+        free(reply);
+        return;
+    }
+
+    int length = xcb_get_property_value_length(reply);
+    uint32_t items = reply->value_len;
+    const char *bytes = xcb_get_property_value(reply);
+    if (reply->format == 8 && reply->bytes_after > 0) {
+        // Drop a character split by the cut, keeping one that ends right at it
+        uint32_t lead = items, tail = 0;
+        while (lead > 0 && tail < 3 && ((unsigned char)bytes[lead - 1] & 0xc0) == 0x80) {
+            lead--;
+            tail++;
+        }
+        if (lead > 0) {
+            unsigned char b = bytes[lead - 1];
+            uint32_t need = b >= 0xf0 ? 3 : b >= 0xe0 ? 2 : b >= 0xc0 ? 1 : 0;
+            if (tail < need)
+                items = lead - 1;
+        }
+        length = items;
+    }
+
+    value->data = malloc(length + 1);
+    if (value->data) {
+        memcpy(value->data, bytes, length);
+        ((char *)value->data)[length] = '\0';
+        value->items = items;
+        value->format = reply->format;
+        value->type = reply->type;
+    }
+    free(reply);
+}
+
+void props_fetch_all(ClientProps *props, Window window) {
+    xcb_connection_t *conn = XGetXCBConnection(wm.display);
+    xcb_get_property_cookie_t cookies[PROP_COUNT];
+
+    for (int i = 0; i < PROP_COUNT; i++)
+        cookies[i] = request(conn, window, i);
+    xstats_round_trip(__FILE__, __LINE__, "props_fetch_all");
+    for (int i = 0; i < PROP_COUNT; i++)
+        store(&props->values[i], conn, cookies[i]);
+    props->valid = (1u << PROP_COUNT) - 1;
+}
+
+bool props_invalidate(ClientProps *props, Atom atom) {
+    for (int i = 0; i < PROP_COUNT; i++) {
+        if (slot_atom(i) == atom) {
+            props->valid &= ~(1u << i);
+            return true;
+        }
+    }
+    return false;
+}
+
+const PropValue *props_get(ClientProps *props, Window window, int slot) {
+    if (!(props->valid & (1u << slot))) {
+        xcb_connection_t *conn = XGetXCBConnection(wm.display);
+        xstats_round_trip(__FILE__, __LINE__, "props_get");
+        store(&props->values[slot], conn, request(conn, window, slot));
+        props->valid |= 1u << slot;
+    }
+    return &props->values[slot];
+}
+
+void props_clear(ClientProps *props) {
+    for (int i = 0; i < PROP_COUNT; i++)
+        free(props->values[i].data);
+    memset(props, 0, sizeof(*props));
+}
+
+char *props_title(ClientProps *props, Window window) {
+    const PropValue *value = props_get(props, window, PROP_NET_WM_NAME);
+    if (!value->data || value->type != wm.atoms[UTF8_STRING] || value->format != 8)
+        value = props_get(props, window, PROP_WM_NAME);
+    if (!value->data || value->format != 8)
+        return NULL;
+    return strndup(value->data, value->items);
+}
+
+bool props_has_protocol(ClientProps *props, Window window, Atom protocol) {
+    const PropValue *value = props_get(props, window, PROP_WM_PROTOCOLS);
+    if (!value->data || value->format != 32)
+        return false;
+    const uint32_t *atoms = value->data;
+    for (uint32_t i = 0; i < value->items; i++) {
+        if (atoms[i] == protocol)
+            return true;
+    }
+    return false;
+}
+
+bool props_has_state(ClientProps *props, Window window, Atom state) {
+    const PropValue *value = props_get(props, window, PROP_NET_WM_STATE);
+    if (!value->data || value->format != 32)
+        return false;
+    const uint32_t *atoms = value->data;
+    for (uint32_t i = 0; i < value->items; i++) {
+        if (atoms[i] == state)
+            return true;
+    }
+    return false;
+}
+
+bool props_is_urgent(ClientProps *props, Window window) {
+    const PropValue *value = props_get(props, window, PROP_WM_HINTS);
+    return value->data && value->format == 32 && value->items >= 1 &&
+           (((const uint32_t *)value->data)[0] & XUrgencyHint);
+}
+
+pid_t props_pid(ClientProps *props, Window window) {
+    const PropValue *value = props_get(props, window, PROP_NET_WM_PID);
+    if (!value->data || value->format != 32 || value->items < 1)
+        return 0;
+    return (pid_t)((const uint32_t *)value->data)[0];
+}
+
+bool props_machine_is(ClientProps *props, Window window, const char *host) {
+    const PropValue *value = props_get(props, window, PROP_WM_CLIENT_MACHINE);
+    return value->data && value->format == 8 && value->items == strlen(host) &&
+           memcmp(value->data, host, value->items) == 0;
+}
@@ -0,0 +1,304 @@
+// src/restart.c
+#include "restart.h"
+#include "wm.h"
+#include "client.h"
+#include "de_supervisor.h"
+#include "ewmh.h"
+#include "wm_events.h"
+#include "xstats.h"
+#include "log.h"
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static struct {
+    char **argv;
+    pid_t nested_server_pid;
+    bool restoring;
+    RestartHeader header;
+    RestartClient *clients;        // Loaded records, freed once restored
+} restart = { .nested_server_pid = -1 };
+
+void restart_init(char **argv, pid_t nested_server_pid) {
+    restart.argv = argv;
+    restart.nested_server_pid = nested_server_pid;
+}
+
+static bool write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* Stacking position of every frame, read from the root's children (bottom first) */
+static void fill_stacking(RestartClient *records, int count) {
+    Window root_ret, parent_ret, *children = NULL;
+    unsigned int nchildren = 0;
+    if (!X_ROUND_TRIP(XQueryTree(wm.display, wm.root, &root_ret, &parent_ret,
+                                 &children, &nchildren)))
+        return;
+
+    for (unsigned int i = 0; i < nchildren; i++) {
+        for (int j = 0; j < count; j++) {
+            if (records[j].frame == children[i])
+                records[j].stack = i;
+        }
+    }
+    if (children) XFree(children);
+}
+
+/* Write the header and one record per client; the fd is left without CLOEXEC */
+static int serialize(void) {
+    int fd = memfd_create("canopy-restart", 0);
+    if (fd < 0) {
+        LOG_ERROR("Cannot create the restart memfd: %s", strerror(errno));
+        return -1;
+    }
+
+    int count = client_manager.num_clients;
+    RestartClient *records = calloc(count ? count : 1, sizeof(*records));
+    if (!records) {
+        close(fd);
+        return -1;
+    }
+
+    int n = 0;
+    for (Client *c = client_first(); c && n < count; c = client_next(c), n++) {
+        RestartClient *r = &records[n];
+        r->window = c->window;
+        r->frame = c->frame;
+        r->x = CLIENT_X(c);
+        r->y = CLIENT_Y(c);
+        r->width = CLIENT_WIDTH(c);
+        r->height = CLIENT_HEIGHT(c);
+        r->saved_x = c->saved_x;
+        r->saved_y = c->saved_y;
+        r->saved_width = c->saved_width;
+        r->saved_height = c->saved_height;
+        r->flags = (client_is_fullscreen(c) ? RESTART_CLIENT_FULLSCREEN : 0) |
+                   (client_is_floating(c) ? RESTART_CLIENT_FLOATING : 0) |
+                   (c == client_manager.focused ? RESTART_CLIENT_FOCUSED : 0);
+    }
+    fill_stacking(records, n);
+
+    RestartHeader header = {
+        .magic = RESTART_MAGIC,
+        .version = RESTART_VERSION,
+        .client_size = sizeof(RestartClient),
+        .num_clients = n,
+        .de_pid = de_supervisor_pid(),
+        .nested_server_pid = restart.nested_server_pid,
+        .desktop_window = wm.desktop_window,
+        .gc = wm.gc ? XGContextFromGC(wm.gc) : 0,
+    };
+
+    bool ok = write_all(fd, &header, sizeof(header)) &&
+              write_all(fd, records, n * sizeof(*records)) &&
+              lseek(fd, 0, SEEK_SET) == 0;
+    free(records);
+    if (!ok) {
+        LOG_ERROR("Cannot write the restart state: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool restart_exec(void) {
+    if (!restart.argv || !restart.argv[0]) {
+        LOG_ERROR("Cannot restart: argv was not recorded.");
+        return false;
+    }
+
+    int fd = serialize();
+    if (fd < 0)
+        return false;
+
+    char fd_str[16];
+    snprintf(fd_str, sizeof(fd_str), "%d", fd);
+    setenv(CANOPY_RESTORE_ENV, fd_str, 1);
+
+    /*
+     * Keep every window we created when our connection closes: the frames
+     * are re-adopted by the new image, which frees the old desktop window,
+     * check window and GC once its own are up. The save-set is only
+     * processed when the resources are destroyed, so clients are not
+     * reparented to the root.
+     */
+    XSetCloseDownMode(wm.display, RetainPermanent);
+    X_ROUND_TRIP(XSync(wm.display, False));
+    wm_events_set_inheritable(true);
+
+    LOG_INFO("Restarting CanopyWM (%d clients).", client_manager.num_clients);
+
+    // PATH lookup picks up an upgraded binary; /proc/self/exe would be the old inode
+    execvp(restart.argv[0], restart.argv);
+    int err = errno;
+    execv("/proc/self/exe", restart.argv);
+    LOG_ERROR("Cannot exec %s: %s", restart.argv[0], strerror(err));
+
+    XSetCloseDownMode(wm.display, DestroyAll);
+    wm_events_set_inheritable(false);
+    unsetenv(CANOPY_RESTORE_ENV);
+    close(fd);
+    return false;
+}
+
+bool restart_load(void) {
+    const char *env = getenv(CANOPY_RESTORE_ENV);
+    if (!env)
+        return false;
+
+    int fd = atoi(env);
+    unsetenv(CANOPY_RESTORE_ENV);
+    if (fd <= 2)
+        return false;
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(RestartHeader))
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LOG_WARN("Cannot read the restart state, starting fresh.");
+        return false;
+    }
+
+    const RestartHeader *header = map;
+    size_t records_size = (size_t)header->num_clients * sizeof(RestartClient);
+    if (header->magic != RESTART_MAGIC || header->version != RESTART_VERSION ||
+        header->client_size != sizeof(RestartClient) ||
+        (size_t)st.st_size < sizeof(*header) + records_size) {
+        LOG_WARN("Restart state has an unknown format, starting fresh.");
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    restart.header = *header;
+    restart.clients = malloc(records_size ? records_size : 1);
+    if (restart.clients)
+        memcpy(restart.clients, header + 1, records_size);
+    else
+        restart.header.num_clients = 0;
+    munmap(map, st.st_size);
+
+    restart.restoring = true;
+    LOG_INFO("Restoring session of the previous image (%u clients).",
+             restart.header.num_clients);
+    return true;
+}
+
+const RestartHeader *restart_state(void) {
+    return restart.restoring ? &restart.header : NULL;
+}
+
+static bool window_in(Window w, const Window *list, unsigned int count) {
+    for (unsigned int i = 0; i < count; i++) {
+        if (list[i] == w)
+            return true;
+    }
+    return false;
+}
+
+static int compare_stack_desc(const void *a, const void *b) {
+    const RestartClient *ra = *(const RestartClient *const *)a;
+    const RestartClient *rb = *(const RestartClient *const *)b;
+    return (ra->stack < rb->stack) - (ra->stack > rb->stack);
+}
+
+void restart_restore_clients(void) {
+    if (!restart.restoring)
+        return;
+
+    RestartHeader *header = &restart.header;
+
+    // Only frames still among the root's children are looked at, so a
+    // client destroyed during the exec cannot raise BadWindow
+    Window root_ret, parent_ret, *top = NULL;
+    unsigned int ntop = 0;
+    X_ROUND_TRIP(XQueryTree(wm.display, wm.root, &root_ret, &parent_ret, &top, &ntop));
+
+    RestartClient **adopted = calloc(header->num_clients ? header->num_clients : 1,
+                                     sizeof(*adopted));
+    int num_adopted = 0;
+    Client *focused = NULL;
+
+    // Records are in slot order; adopting them in order keeps that order
+    for (int i = 0; i < (int)header->num_clients; i++) {
+        RestartClient *r = &restart.clients[i];
+        if (!window_in(r->frame, top, ntop))
+            continue;
+
+        Window *inner = NULL;
+        unsigned int ninner = 0;
+        bool intact = X_ROUND_TRIP(XQueryTree(wm.display, r->frame, &root_ret, &parent_ret,
+                                              &inner, &ninner)) && window_in(r->window, inner, ninner);
+        if (inner) XFree(inner);
+        if (!intact) {
+            XDestroyWindow(wm.display, r->frame);
+            continue;
+        }
+
+        Client *c = client_adopt(r->window, r->frame);
+        if (!c) continue;
+
+        CLIENT_X(c) = r->x;
+        CLIENT_Y(c) = r->y;
+        CLIENT_WIDTH(c) = r->width;
+        CLIENT_HEIGHT(c) = r->height;
+        c->saved_x = r->saved_x;
+        c->saved_y = r->saved_y;
+        c->saved_width = r->saved_width;
+        c->saved_height = r->saved_height;
+        client_set_flag(c, CLIENT_FLAG_FULLSCREEN, r->flags & RESTART_CLIENT_FULLSCREEN);
+        client_set_flag(c, CLIENT_FLAG_FLOATING, r->flags & RESTART_CLIENT_FLOATING);
+        if (r->flags & RESTART_CLIENT_FOCUSED)
+            focused = c;
+        if (adopted)
+            adopted[num_adopted++] = r;
+    }
+    if (top) XFree(top);
+
+    // Reassert the stacking order, topmost first
+    if (adopted && num_adopted > 1) {
+        qsort(adopted, num_adopted, sizeof(*adopted), compare_stack_desc);
+        Window *frames = malloc(num_adopted * sizeof(Window));
+        if (frames) {
+            for (int i = 0; i < num_adopted; i++)
+                frames[i] = adopted[i]->frame;
+            XRestackWindows(wm.display, frames, num_adopted);
+            free(frames);
+        }
+        for (int i = num_adopted - 1; i >= 0; i--)
+            ewmh_client_raised(adopted[i]->window);
+    }
+    free(adopted);
+
+    if (focused)
+        client_focus(focused);
+
+    // The frames are ours now; free what else the old image retained. Its
+    // connection cannot be killed as a whole, as that would take the frames.
+    if (header->desktop_window && header->desktop_window != wm.desktop_window)
+        XDestroyWindow(wm.display, header->desktop_window);
+    if (header->gc)
+        xcb_free_gc(XGetXCBConnection(wm.display), header->gc);
+
+    LOG_INFO("Re-adopted %d of %u clients.", client_manager.num_clients, header->num_clients);
+    free(restart.clients);
+    restart.clients = NULL;
+}
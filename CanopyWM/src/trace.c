@@ -0,0 +1,103 @@
+// src/trace.c
+#include "trace.h"
+#include "log.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Worker threads trace too, so a write error only switches tracing off;
+ * the descriptor itself stays open until trace_close(), which runs after
+ * the worker pool has been joined.
+ */
+static _Atomic int trace_fd = -1;      // -1 while tracing is off
+static int trace_file = -1;            // Owned descriptor, closed by trace_close()
+
+static uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Each event goes out in one write() on an O_APPEND descriptor, so events
+ * from both processes interleave whole. The array is left unterminated,
+ * which the trace viewers accept.
+ */
+static void trace_write(const char *buf, int len) {
+    int fd = atomic_load_explicit(&trace_fd, memory_order_relaxed);
+    if (fd < 0)
+        return;
+    if ((len <= 0 || write(fd, buf, len) != len) && atomic_exchange(&trace_fd, -1) >= 0)
+        LOG_WARN("Cannot write trace event, tracing disabled.");
+}
+
+void trace_init(const char *process_name, int truncate) {
+    const char *path = getenv(CANOPY_TRACE_ENV);
+    if (!path || !path[0] || trace_file >= 0)
+        return;
+
+    int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (truncate ? O_TRUNC : 0);
+    trace_file = open(path, flags, 0644);
+    if (trace_file < 0) {
+        LOG_WARN("Cannot open trace file %s: %s", path, strerror(errno));
+        return;
+    }
+    atomic_store(&trace_fd, trace_file);
+
+    char buf[256];
+    struct stat st;
+    if (fstat(trace_file, &st) == 0 && st.st_size == 0)
+        trace_write("[\n", 2);
+    if (atomic_load(&trace_fd) >= 0) {
+        trace_write(buf, snprintf(buf, sizeof(buf),
+            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"name\":\"%s\"}},\n",
+            (int)getpid(), (int)getpid(), process_name));
+    }
+    LOG_INFO("Writing startup trace to %s", path);
+}
+
+// Only once no other thread can trace any more
+void trace_close(void) {
+    atomic_store(&trace_fd, -1);
+    if (trace_file >= 0) {
+        close(trace_file);
+        trace_file = -1;
+    }
+}
+
+uint64_t trace_begin(void) {
+    return atomic_load_explicit(&trace_fd, memory_order_relaxed) >= 0 ? trace_now() : 0;
+}
+
+// Names are phase and function identifiers and are written unescaped
+void trace_end(const char *name, uint64_t start) {
+    if (start == 0 || atomic_load_explicit(&trace_fd, memory_order_relaxed) < 0)
+        return;
+
+    char buf[256];
+    trace_write(buf, snprintf(buf, sizeof(buf),
+        "{\"name\":\"%s\",\"cat\":\"startup\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,"
+        "\"pid\":%d,\"tid\":%d},\n",
+        name, (unsigned long long)start, (unsigned long long)(trace_now() - start),
+        (int)getpid(), (int)syscall(SYS_gettid)));
+}
+
+void trace_instant(const char *name) {
+    if (atomic_load_explicit(&trace_fd, memory_order_relaxed) < 0)
+        return;
+
+    char buf[256];
+    trace_write(buf, snprintf(buf, sizeof(buf),
+        "{\"name\":\"%s\",\"cat\":\"startup\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%llu,"
+        "\"pid\":%d,\"tid\":%d},\n",
+        name, (unsigned long long)trace_now(), (int)getpid(), (int)syscall(SYS_gettid)));
+}
@@ -1,6 +1,17 @@
 #include "wm.h"
 #include "input.h"
 #include "client.h"
+#include "config.h"
+#include "cpu_policy.h"
+#include "desktop_window.h"
+#include "event_loop.h"
+#include "ewmh.h"
+#include "ping.h"
+#include "wm_interface.h"
+#include "worker_pool.h"
+#include "xerror.h"
+#include "xstats.h"
+#include "log.h"
 #include <X11/Xcursor/Xcursor.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -38,15 +49,23 @@ static void wm_init_atoms(void) {
         "_NET_WM_WINDOW_TYPE_UTILITY",
         "_NET_WM_WINDOW_TYPE_SPLASH",
         "_NET_WM_WINDOW_TYPE_DIALOG",
-        "_NET_WM_WINDOW_TYPE_NORMAL"
+        "_NET_WM_WINDOW_TYPE_NORMAL",
+        "_NET_SUPPORTED",
+        "_NET_SUPPORTING_WM_CHECK",
+        "_NET_CLIENT_LIST",
+        "_NET_CLIENT_LIST_STACKING",
+        "_NET_WM_PID",
+        "_NET_WM_PING",
+        "UTF8_STRING"
     };
 
-    XInternAtoms(wm.display, (char **)atom_names, ATOM_COUNT, False, wm.atoms);
+    X_ROUND_TRIP(XInternAtoms(wm.display, (char **)atom_names, ATOM_COUNT, False, wm.atoms));
 }
 
 /* Initialize modifier masks */
 static void wm_init_masks(void) {
-    XModifierKeymap *modmap = XGetModifierMapping(wm.display);
+    wm.num_lock_mask = wm.scroll_lock_mask = wm.caps_lock_mask = 0;
+    XModifierKeymap *modmap = X_ROUND_TRIP(XGetModifierMapping(wm.display));
     if (modmap && modmap->max_keypermod > 0) {
         const KeyCode num_lock = XKeysymToKeycode(wm.display, XK_Num_Lock);
         const KeyCode scroll_lock = XKeysymToKeycode(wm.display, XK_Scroll_Lock);
@@ -73,6 +92,7 @@ void wm_init(void) {
         fprintf(stderr, "Cannot open display\n");
         exit(1);
     }
+    xerror_init(wm.display);
     wm.screen = DefaultScreen(wm.display);
     wm.root = RootWindow(wm.display, wm.screen);
     wm.gc = XCreateGC(wm.display, wm.root, 0, NULL);
@@ -103,8 +123,8 @@ void wm_init(void) {
             fprintf(stderr, "Failed to create desktop window\n");
             exit(1);
         }
-        Atom net_wm_window_type = XInternAtom(wm.display, "_NET_WM_WINDOW_TYPE", False);
-        Atom desktop_type = XInternAtom(wm.display, "_NET_WM_WINDOW_TYPE_DESKTOP", False);
+        Atom net_wm_window_type = X_ROUND_TRIP(XInternAtom(wm.display, "_NET_WM_WINDOW_TYPE", False));
+        Atom desktop_type = X_ROUND_TRIP(XInternAtom(wm.display, "_NET_WM_WINDOW_TYPE_DESKTOP", False));
         XChangeProperty(wm.display, wm.desktop_window, net_wm_window_type, XA_ATOM, 32,
                         PropModeReplace, (unsigned char *)&desktop_type, 1);
         XMapWindow(wm.display, wm.desktop_window);
@@ -119,24 +139,26 @@ void wm_init(void) {
     wm_init_masks();
 
     /* Initialize RandR extension. */
-    if (!XRRQueryExtension(wm.display, &wm.randr_event_base, &wm.randr_error_base)) {
+    if (!X_ROUND_TRIP(XRRQueryExtension(wm.display, &wm.randr_event_base, &wm.randr_error_base))) {
         fprintf(stderr, "RandR extension not available\n");
         wm.randr_event_base = -1;
         wm.randr_error_base = -1;
     }
 
-    /* Initialize systemd bus connection. */
-    int ret = sd_bus_default_system(&wm.bus);
-    if (ret < 0) {
-        fprintf(stderr, "Failed to connect to system bus: %s\n", strerror(-ret));
-        wm.bus = NULL;
-    }
+    /* The system bus is connected off the main thread, see wm_bus_connect(). */
+    wm.bus = NULL;
 
-    /* Set input events on the root window. */
+    /*
+     * Set input events on the root window. The sync makes a running WM's
+     * BadAccess arrive (and exit us) before the EWMH properties it owns
+     * are overwritten.
+     */
     XSelectInput(wm.display, wm.root,
                  SubstructureRedirectMask | SubstructureNotifyMask |
                  ButtonPressMask | KeyPressMask | PropertyChangeMask |
                  EnterWindowMask | LeaveWindowMask | FocusChangeMask);
+    X_ROUND_TRIP(XSync(wm.display, False));
+    ewmh_init();
 
     wm_grab_keys();
     wm_grab_buttons();
@@ -145,6 +167,35 @@ void wm_init(void) {
     wm.focused_window = None;
 }
 
+/*
+ * Connect to the system bus. Uses a private connection rather than the
+ * per-thread default bus so it can be opened on a worker thread and then
+ * handed to the main thread with wm_bus_publish().
+ */
+sd_bus *wm_bus_connect(void) {
+    sd_bus *bus = NULL;
+    int ret = sd_bus_open_system(&bus);
+    if (ret < 0) {
+        fprintf(stderr, "Failed to connect to system bus: %s\n", strerror(-ret));
+        return NULL;
+    }
+    return bus;
+}
+
+static void process_system_bus(int fd, void *data) {
+    (void)fd;
+    (void)data;
+    while (sd_bus_process(wm.bus, NULL) > 0)
+        ;
+}
+
+/* Watch the bus from the event loop so asynchronous calls get their replies */
+void wm_bus_publish(sd_bus *bus) {
+    wm.bus = bus;
+    if (bus)
+        event_loop_add_fd(sd_bus_get_fd(bus), process_system_bus, NULL);
+}
+
 /* Cleanup WM resources, including desktop window and Cairo contexts */
 void wm_cleanup(void) {
     if (wm.cr) {
@@ -163,13 +214,20 @@ void wm_cleanup(void) {
         cairo_surface_destroy(wm.desktop_surface);
         wm.desktop_surface = NULL;
     }
+    if (wm.wallpaper) {
+        cairo_surface_destroy(wm.wallpaper);
+        wm.wallpaper = NULL;
+    }
     if (wm.gc) {
         XFreeGC(wm.display, wm.gc);
     }
     if (wm.bus) {
-        sd_bus_unref(wm.bus);
+        event_loop_remove_fd(sd_bus_get_fd(wm.bus));
+        sd_bus_flush_close_unref(wm.bus);
+        wm.bus = NULL;
     }
     if (wm.display) {
+        ewmh_cleanup();
         XCloseDisplay(wm.display);
     }
 }
@@ -203,6 +261,12 @@ void wm_handle_event(XEvent *ev) {
         case KeyPress:
             wm_handle_key_press(&ev->xkey);
             break;
+        case Expose:
+            wm_handle_expose(&ev->xexpose);
+            break;
+        case MappingNotify:
+            wm_handle_mapping_notify(&ev->xmapping);
+            break;
         default:
             /* Handle additional event types if needed */
             break;
@@ -224,7 +288,8 @@ void wm_run(void) {
 /* When a window is mapped, add it as a client if it is not override-redirect */
 void wm_handle_map_request(XMapRequestEvent *ev) {
     XWindowAttributes attr;
-    XGetWindowAttributes(wm.display, ev->window, &attr);
+    if (!X_ROUND_TRIP(XGetWindowAttributes(wm.display, ev->window, &attr)))
+        return;    /* Destroyed before we got to it */
     if (!attr.override_redirect) {
         /* Optionally, you could adjust the initial position here too */
         XMapWindow(wm.display, ev->window);
@@ -266,24 +331,47 @@ void wm_handle_configure_request(XConfigureRequestEvent *ev) {
     XConfigureWindow(wm.display, ev->window, ev->value_mask, &changes);
 }
 
-/* Update client title when the window property changes */
+/* Drop the cached copy of a changed property and apply title and urgency changes */
 void wm_handle_property_notify(XPropertyEvent *ev) {
-    if (ev->atom == XA_WM_NAME) {
-        Client *c = client_find_by_window(ev->window);
-        if (c) {
-            client_update_title(c);
-        }
+    Client *c = client_find_by_window(ev->window);
+    if (!c || !props_invalidate(&c->props, ev->atom))
+        return;
+
+    if (ev->atom == XA_WM_NAME || ev->atom == wm.atoms[NET_WM_NAME]) {
+        client_title_changed(c);
+    } else if (ev->atom == XA_WM_HINTS) {
+        client_update_urgency(c);
     }
 }
 
 /* Handle client messages, such as the WM_DELETE_WINDOW protocol */
 void wm_handle_client_message(XClientMessageEvent *ev) {
+    wm_interface_handle_message((XEvent *)ev);
+
     if (ev->message_type == wm.atoms[WM_PROTOCOLS] &&
-        (Atom)ev->data.l[0] == wm.atoms[WM_DELETE_WINDOW]) {
+        (Atom)ev->data.l[0] == wm.atoms[NET_WM_PING] && ev->window == wm.root) {
+        /* A client answering _NET_WM_PING; l[2] is the pinged window */
+        ping_reply((Window)ev->data.l[2], ev->data.l[1]);
+    } else if (ev->message_type == wm.atoms[WM_PROTOCOLS] &&
+               (Atom)ev->data.l[0] == wm.atoms[WM_DELETE_WINDOW]) {
         Client *c = client_find_by_window(ev->window);
         if (c) {
             client_close(c);
         }
+    } else if (ev->message_type == wm.atoms[NET_ACTIVE_WINDOW]) {
+        /* Activation request from a pager or taskbar */
+        Client *c = client_find_by_window(ev->window);
+        if (c) {
+            client_focus(c);
+        }
+    } else if (ev->message_type == wm.atoms[NET_WM_STATE]) {
+        /* l[0] is remove (0), add (1) or toggle (2); l[1] and l[2] the states */
+        Client *c = client_find_by_window(ev->window);
+        if (c && ((Atom)ev->data.l[1] == wm.atoms[NET_WM_STATE_FULLSCREEN] ||
+                  (Atom)ev->data.l[2] == wm.atoms[NET_WM_STATE_FULLSCREEN])) {
+            bool fullscreen = ev->data.l[0] == 2 ? !client_is_fullscreen(c) : ev->data.l[0] == 1;
+            client_set_fullscreen(c, fullscreen);
+        }
     }
 }
 
@@ -312,39 +400,163 @@ void wm_handle_key_press(XKeyEvent *ev) {
     input_handle_key((XEvent *)ev);
 }
 
-/* Grab keys for global shortcuts */
-void wm_grab_keys(void) {
-    XUngrabKey(wm.display, AnyKey, AnyModifier, wm.root);
-    unsigned int modifiers[] = { 0, wm.caps_lock_mask, wm.num_lock_mask,
-                                 wm.caps_lock_mask | wm.num_lock_mask };
-    KeyCode keycode;
-    /* Alt+Tab */
-    keycode = XKeysymToKeycode(wm.display, XK_Tab);
-    for (size_t i = 0; i < sizeof(modifiers) / sizeof(modifiers[0]); i++) {
-        XGrabKey(wm.display, keycode, Mod1Mask | modifiers[i],
-                 wm.root, True, GrabModeAsync, GrabModeAsync);
+/*
+ * The keyboard or modifier mapping changed (xmodmap, setxkbmap, a new XKB
+ * layout): keycodes and lock masks may have moved, so re-resolve the
+ * keybinding table and regrab.
+ */
+void wm_handle_mapping_notify(XMappingEvent *ev) {
+    XRefreshKeyboardMapping(ev);
+    if (ev->request == MappingPointer)
+        return;
+
+    wm_init_masks();
+    wm_grab_keys();
+    wm_grab_buttons();
+}
+
+/* Repaint the wallpaper or a client frame once its last expose arrives */
+void wm_handle_expose(XExposeEvent *ev) {
+    if (ev->count != 0)
+        return;
+    if (ev->window == wm.desktop_window) {
+        wm_render_wallpaper();
+        return;
     }
-    /* Alt+F4 */
-    keycode = XKeysymToKeycode(wm.display, XK_F4);
-    for (size_t i = 0; i < sizeof(modifiers) / sizeof(modifiers[0]); i++) {
-        XGrabKey(wm.display, keycode, Mod1Mask | modifiers[i],
-                 wm.root, True, GrabModeAsync, GrabModeAsync);
+    Client *c = client_find_by_window(ev->window);
+    if (c && c->frame == ev->window) {
+        client_draw_decorations(c);
     }
 }
 
+/* -- Configuration -- */
+
+/*
+ * Reapply only the parts of the configuration that changed on reload:
+ * keybinds are regrabbed, decoration changes repaint the frames and
+ * appearance changes re-render the wallpaper.
+ */
+void wm_apply_config(unsigned int changed) {
+    if (changed & CONFIG_CHANGED_KEYBINDS) {
+        input_apply_keybinds();
+    }
+    if (changed & CONFIG_CHANGED_FRAME) {
+        client_reframe_all();
+    } else if (changed & CONFIG_CHANGED_DECORATION) {
+        client_redraw_all();
+    }
+    if (changed & CONFIG_CHANGED_APPEARANCE)
+        wm_reload_wallpaper();
+    if (changed & CONFIG_CHANGED_SYSTEM)
+        cpu_policy_changed();
+    XFlush(wm.display);
+}
+
+/* Safe on a worker thread: touches nothing but the file and a new surface */
+static cairo_surface_t *decode_wallpaper(const char *path) {
+    cairo_surface_t *image = cairo_image_surface_create_from_png(path);
+    if (cairo_surface_status(image) != CAIRO_STATUS_SUCCESS) {
+        LOG_ERROR("Failed to load wallpaper %s", path);
+        cairo_surface_destroy(image);
+        return NULL;
+    }
+    return image;
+}
+
+static void set_wallpaper(cairo_surface_t *image) {
+    if (wm.wallpaper)
+        cairo_surface_destroy(wm.wallpaper);
+    wm.wallpaper = image;
+}
+
+/* Decode the configured wallpaper; falls back to the background color */
+void wm_load_wallpaper(void) {
+    set_wallpaper(config.appearance.wallpaper_path ?
+                  decode_wallpaper(config.appearance.wallpaper_path) : NULL);
+}
+
+typedef struct {
+    char *path;
+    unsigned int generation;
+    cairo_surface_t *image;
+} WallpaperJob;
+
+static unsigned int wallpaper_generation;
+
+static void *load_wallpaper_job(void *data) {
+    WallpaperJob *job = data;
+    job->image = decode_wallpaper(job->path);
+    return job;
+}
+
+static void publish_wallpaper_job(void *result) {
+    WallpaperJob *job = result;
+    if (job->generation == wallpaper_generation) {
+        set_wallpaper(job->image);
+        wm_render_wallpaper();
+    } else if (job->image) {
+        cairo_surface_destroy(job->image);    // A newer reload superseded it
+    }
+    free(job->path);
+    free(job);
+}
+
+/* Like wm_load_wallpaper() plus a redraw, with the decode on a worker thread */
+void wm_reload_wallpaper(void) {
+    const char *path = config.appearance.wallpaper_path;
+    WallpaperJob *job = path ? calloc(1, sizeof(*job)) : NULL;
+    wallpaper_generation++;
+    if (job) {
+        job->path = strdup(path);
+        job->generation = wallpaper_generation;
+        if (job->path && worker_pool_submit("wallpaper_decode", load_wallpaper_job,
+                                            publish_wallpaper_job, job))
+            return;
+        free(job->path);
+        free(job);
+    }
+    wm_load_wallpaper();    // No wallpaper configured, or no memory for the job
+    wm_render_wallpaper();
+}
+
+void wm_render_wallpaper(void) {
+    if (!wm.desktop_cr)
+        return;
+
+    if (wm.wallpaper) {
+        render_wallpaper_on_desktop(wm.display, wm.screen, wm.desktop_window,
+                                    wm.desktop_surface, wm.desktop_cr, wm.wallpaper);
+        return;
+    }
+
+    unsigned int bg = config.appearance.background_color;
+    cairo_set_source_rgb(wm.desktop_cr,
+                         ((bg >> 16) & 0xff) / 255.0,
+                         ((bg >> 8) & 0xff) / 255.0,
+                         (bg & 0xff) / 255.0);
+    cairo_paint(wm.desktop_cr);
+    cairo_surface_flush(wm.desktop_surface);
+    XFlush(wm.display);
+}
+
+/* Grab keys for global shortcuts; the bindings themselves live in input.c */
+void wm_grab_keys(void) {
+    input_rebuild_keymap();
+}
+
 /* Grab buttons for window move/resize operations */
 void wm_grab_buttons(void) {
     XUngrabButton(wm.display, AnyButton, AnyModifier, wm.root);
-    unsigned int modifiers[] = { 0, wm.caps_lock_mask, wm.num_lock_mask,
-                                 wm.caps_lock_mask | wm.num_lock_mask };
+    /* Lock variants are shared with the key grabs, see wm_grab_keys() */
+    const unsigned int *modifiers = input_manager.lock_masks;
     /* Alt + Left click for moving windows */
-    for (size_t i = 0; i < sizeof(modifiers) / sizeof(modifiers[0]); i++) {
+    for (int i = 0; i < input_manager.num_lock_masks; i++) {
         XGrabButton(wm.display, Button1, Mod1Mask | modifiers[i],
                     wm.root, True, ButtonPressMask | ButtonReleaseMask | PointerMotionMask,
                     GrabModeAsync, GrabModeAsync, None, None);
     }
     /* Alt + Right click for resizing windows */
-    for (size_t i = 0; i < sizeof(modifiers) / sizeof(modifiers[0]); i++) {
+    for (int i = 0; i < input_manager.num_lock_masks; i++) {
         XGrabButton(wm.display, Button3, Mod1Mask | modifiers[i],
                     wm.root, True, ButtonPressMask | ButtonReleaseMask | PointerMotionMask,
                     GrabModeAsync, GrabModeAsync, None, None);
@@ -355,18 +567,19 @@ void wm_grab_buttons(void) {
 
 /* Retrieve an atom by name */
 Atom wm_get_atom(const char *name) {
-    return XInternAtom(wm.display, name, False);
+    return X_ROUND_TRIP(XInternAtom(wm.display, name, False));
 }
 
-/* Get a window property of a given type */
+/* Get a window property of a given type, at most WM_PROP_MAX_LENGTH 32-bit units of it */
 bool wm_get_window_prop(Window w, Atom prop, Atom type, int format,
                         unsigned char **data, unsigned long *items) {
     Atom actual_type;
     int actual_format;
     unsigned long bytes_after;
-    if (XGetWindowProperty(wm.display, w, prop, 0, (~0L), False, type,
-                           &actual_type, &actual_format, items, &bytes_after,
-                           data) == Success && actual_type == type) {
+    if (X_ROUND_TRIP(XGetWindowProperty(wm.display, w, prop, 0, WM_PROP_MAX_LENGTH, False,
+                                        type, &actual_type, &actual_format, items,
+                                        &bytes_after, data)) == Success &&
+        actual_type == type) {
         return true;
     }
     return false;
@@ -387,7 +600,7 @@ Window wm_get_focused_window(void) {
 /* Determine if a window is mapped (viewable) */
 bool wm_is_window_mapped(Window w) {
     XWindowAttributes attr;
-    if (XGetWindowAttributes(wm.display, w, &attr)) {
+    if (X_ROUND_TRIP(XGetWindowAttributes(wm.display, w, &attr))) {
         return attr.map_state == IsViewable;
     }
     return false;
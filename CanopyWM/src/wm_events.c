@@ -0,0 +1,247 @@
+// src/wm_events.c
+#include "wm_events.h"
+#include "client.h"
+#include "ipc.h"
+#include "log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static struct {
+    WmEventRing *ring;
+    int ring_fd;
+    int notify_fd;
+    bool pending;               // Published since the last flush
+    bool overflowed;            // Dropped events; a snapshot is being streamed
+    bool snapshot_started;      // RESET is queued, clients from snapshot_slot on are not
+    uint32_t snapshot_slot;
+    uint64_t dropped;
+} events = { .ring_fd = -1, .notify_fd = -1 };
+
+static uint32_t ring_free(void) {
+    uint64_t head = atomic_load_explicit(&events.ring->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&events.ring->tail, memory_order_acquire);
+    return WM_EVENTS_SLOTS - (uint32_t)(head - tail);
+}
+
+/* Append one record; the caller has checked there is room */
+static void push(uint32_t type, Window window, uint32_t value, const char *title) {
+    uint64_t head = atomic_load_explicit(&events.ring->head, memory_order_relaxed);
+    WmEventRecord *r = &events.ring->records[head & (WM_EVENTS_SLOTS - 1)];
+
+    size_t len = title ? strlen(title) : 0;
+    if (len > WM_EVENTS_TITLE_LEN) {
+        // Cut on a UTF-8 character boundary
+        len = WM_EVENTS_TITLE_LEN;
+        while (len > 0 && ((unsigned char)title[len] & 0xc0) == 0x80)
+            len--;
+    }
+    r->type = type;
+    r->window = window;
+    r->value = value;
+    r->title_len = len;
+    if (len) memcpy(r->title, title, len);
+
+    atomic_store_explicit(&events.ring->head, head + 1, memory_order_release);
+    events.pending = true;
+}
+
+/*
+ * Stream RESET, the client list and the focus into the ring as room allows.
+ * A long client list does not fit the ring at once, so it is continued on
+ * every flush. Events published meanwhile are queued as usual and may
+ * overlap with it; the DE does no filtering of its own but relies on its
+ * taskbar ignoring a duplicate ADD and TITLE or URGENT for a window it does
+ * not know yet, which the snapshot then adds with its current state.
+ * Returns true once complete.
+ */
+static bool push_snapshot(void) {
+    if (!events.snapshot_started) {
+        if (ring_free() == 0)
+            return false;
+        push(WM_EVENT_RESET, None, 0, NULL);
+        events.snapshot_started = true;
+        events.snapshot_slot = 0;
+    }
+
+    for (Client *c = client_first(); c; c = client_next(c)) {
+        if (c->slot < events.snapshot_slot)
+            continue;
+        if (ring_free() < 3)
+            return false;
+        push(WM_EVENT_CLIENT_ADD, c->window, 0, client_title(c));
+        if (c->is_urgent)
+            push(WM_EVENT_CLIENT_URGENT, c->window, 1, NULL);
+        if (c->not_responding)
+            push(WM_EVENT_CLIENT_NOT_RESPONDING, c->window, 1, NULL);
+        events.snapshot_slot = c->slot + 1;
+    }
+
+    if (ring_free() == 0)
+        return false;
+    push(WM_EVENT_CLIENT_FOCUS, client_manager.focused ? client_manager.focused->window : None,
+         0, NULL);
+    events.snapshot_started = false;
+    return true;
+}
+
+/* Continue an interrupted snapshot; done once the DE has the whole list */
+static void resync(void) {
+    if (!push_snapshot())
+        return;
+    if (events.dropped)
+        LOG_INFO("DE event ring resynced after %llu dropped events.",
+                 (unsigned long long)events.dropped);
+    events.overflowed = false;
+    events.dropped = 0;
+}
+
+static bool open_inherited(void) {
+    const char *ring_env = getenv(CANOPY_EVENT_RING_ENV);
+    const char *notify_env = getenv(CANOPY_EVENT_NOTIFY_ENV);
+    if (!ring_env || !notify_env)
+        return false;
+
+    int ring_fd = atoi(ring_env);
+    int notify_fd = atoi(notify_env);
+    struct stat st;
+    if (ring_fd <= 2 || notify_fd <= 2 || fstat(ring_fd, &st) < 0 ||
+        (size_t)st.st_size != sizeof(WmEventRing) || fcntl(notify_fd, F_GETFD) < 0)
+        return false;
+
+    WmEventRing *ring = mmap(NULL, sizeof(WmEventRing), PROT_READ | PROT_WRITE,
+                             MAP_SHARED, ring_fd, 0);
+    if (ring == MAP_FAILED)
+        return false;
+    if (ring->magic != WM_EVENTS_MAGIC || ring->version != WM_EVENTS_VERSION) {
+        munmap(ring, sizeof(WmEventRing));
+        return false;
+    }
+
+    fcntl(ring_fd, F_SETFD, FD_CLOEXEC);
+    fcntl(notify_fd, F_SETFD, FD_CLOEXEC);
+    events.ring = ring;
+    events.ring_fd = ring_fd;
+    events.notify_fd = notify_fd;
+    LOG_INFO("Reusing the DE event ring from the previous image.");
+    return true;
+}
+
+bool wm_events_init(void) {
+    // After a restart the running DE still consumes the old ring
+    if (open_inherited())
+        return true;
+
+    events.ring_fd = memfd_create("canopy-events", MFD_CLOEXEC);
+    if (events.ring_fd < 0 || ftruncate(events.ring_fd, sizeof(WmEventRing)) < 0) {
+        LOG_WARN("Cannot create the DE event ring: %s", strerror(errno));
+        wm_events_cleanup();
+        return false;
+    }
+    events.ring = mmap(NULL, sizeof(WmEventRing), PROT_READ | PROT_WRITE,
+                       MAP_SHARED, events.ring_fd, 0);
+    if (events.ring == MAP_FAILED) {
+        events.ring = NULL;
+        LOG_WARN("Cannot map the DE event ring: %s", strerror(errno));
+        wm_events_cleanup();
+        return false;
+    }
+    events.ring->magic = WM_EVENTS_MAGIC;
+    events.ring->version = WM_EVENTS_VERSION;
+    events.ring->slot_count = WM_EVENTS_SLOTS;
+    events.ring->slot_size = sizeof(WmEventRecord);
+
+    events.notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (events.notify_fd < 0) {
+        LOG_WARN("Cannot create the DE event eventfd: %s", strerror(errno));
+        wm_events_cleanup();
+        return false;
+    }
+
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d", events.ring_fd);
+    setenv(CANOPY_EVENT_RING_ENV, buf, 1);
+    snprintf(buf, sizeof(buf), "%d", events.notify_fd);
+    setenv(CANOPY_EVENT_NOTIFY_ENV, buf, 1);
+    return true;
+}
+
+void wm_events_cleanup(void) {
+    if (events.ring)
+        munmap(events.ring, sizeof(WmEventRing));
+    if (events.ring_fd >= 0)
+        close(events.ring_fd);
+    if (events.notify_fd >= 0)
+        close(events.notify_fd);
+    events.ring = NULL;
+    events.ring_fd = events.notify_fd = -1;
+    unsetenv(CANOPY_EVENT_RING_ENV);
+    unsetenv(CANOPY_EVENT_NOTIFY_ENV);
+}
+
+/*
+ * Callers publish after changing the client list, so a snapshot taken here
+ * already includes the event and it is not queued separately.
+ */
+void wm_events_publish(uint32_t type, Window window, uint32_t value, const char *title) {
+    ipc_publish(type, window, value, title);
+    if (!events.ring)
+        return;
+
+    // A lost event invalidates everything queued so far, including any
+    // partial snapshot; a pending RESET supersedes the event anyway
+    if (ring_free() == 0) {
+        events.overflowed = true;
+        events.snapshot_started = false;
+        events.dropped++;
+        return;
+    }
+    if (events.overflowed && !events.snapshot_started) {
+        events.dropped++;
+        return;
+    }
+    push(type, window, value, title);
+}
+
+void wm_events_flush(void) {
+    if (events.ring && events.overflowed)
+        resync();
+    if (!events.pending)
+        return;
+    events.pending = false;
+
+    uint64_t one = 1;
+    if (write(events.notify_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        LOG_WARN("Cannot wake the DE: %s", strerror(errno));
+}
+
+/* Only called while no DE is running, so tail can be reset from this side */
+void wm_events_reset(void) {
+    if (!events.ring)
+        return;
+
+    atomic_store_explicit(&events.ring->tail, 0, memory_order_relaxed);
+    atomic_store_explicit(&events.ring->head, 0, memory_order_relaxed);
+    events.overflowed = true;
+    events.snapshot_started = false;
+    events.dropped = 0;
+
+    uint64_t count;
+    while (read(events.notify_fd, &count, sizeof(count)) > 0)
+        ;
+    resync();
+}
+
+void wm_events_set_inheritable(bool inheritable) {
+    int flags = inheritable ? 0 : FD_CLOEXEC;
+    if (events.ring_fd >= 0)
+        fcntl(events.ring_fd, F_SETFD, flags);
+    if (events.notify_fd >= 0)
+        fcntl(events.notify_fd, F_SETFD, flags);
+}
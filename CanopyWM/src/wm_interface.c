@@ -1,18 +1,23 @@
 #include "wm_interface.h"
 #include "wm.h"
+#include "de_supervisor.h"
+#include "xstats.h"
+#include "log.h"
 #include <X11/Xatom.h>
 #include <stdio.h>
+#include <string.h>
 
 static struct {
     Atom wm_ready;
     Atom de_ready;
     bool de_is_ready;
+    struct timespec de_ready_time;  // CLOCK_MONOTONIC time the DE reported ready
     Window root;
 } interface = {0};
 
 void wm_interface_init(Display *display) {
-    interface.wm_ready = XInternAtom(display, CANOPY_WM_READY, False);
-    interface.de_ready = XInternAtom(display, CANOPY_DE_READY, False);
+    interface.wm_ready = X_ROUND_TRIP(XInternAtom(display, CANOPY_WM_READY, False));
+    interface.de_ready = X_ROUND_TRIP(XInternAtom(display, CANOPY_DE_READY, False));
     interface.de_is_ready = false;
     interface.root = DefaultRootWindow(display);
 
@@ -34,10 +39,13 @@ void wm_interface_handle_message(XEvent *ev) {
         
         if (cm->message_type == interface.de_ready) {
             interface.de_is_ready = true;
-            printf("CanopyDE has connected\n");
+            clock_gettime(CLOCK_MONOTONIC, &interface.de_ready_time);
+            LOG_INFO("CanopyDE has drawn its first frame.");
+            de_supervisor_handle_ready();
             
             // Acknowledge DE registration
             XEvent reply;
+            memset(&reply, 0, sizeof(reply));
             reply.type = ClientMessage;
             reply.xclient.window = interface.root;
             reply.xclient.message_type = interface.wm_ready;
@@ -54,4 +62,9 @@ void wm_interface_handle_message(XEvent *ev) {
 
 bool wm_interface_is_de_ready(void) {
     return interface.de_is_ready;
-}
\ No newline at end of file
+}
+
+/* When the DE reported ready; only meaningful once wm_interface_is_de_ready() */
+struct timespec wm_interface_de_ready_time(void) {
+    return interface.de_ready_time;
+}
@@ -0,0 +1,219 @@
+// src/worker_pool.c
+#include "worker_pool.h"
+#include "event_loop.h"
+#include "trace.h"
+#include "log.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+typedef struct WorkerJob {
+    const char *name;
+    WorkerFunc func;
+    WorkerDoneFunc done;
+    void *data;
+    void *result;
+    struct WorkerJob *next;
+} WorkerJob;
+
+// Jobs waiting for a thread
+typedef struct {
+    WorkerJob *head;
+    WorkerJob *tail;
+} WorkerQueue;
+
+static struct {
+    pthread_t threads[WORKER_POOL_THREADS];
+    int num_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    WorkerQueue pending;
+    // Finished jobs, newest first. Workers push with a CAS and the main
+    // loop takes the whole list with one exchange, so neither side locks
+    // and there is no ABA: the only consumer never pops single nodes.
+    _Atomic(WorkerJob *) completed;
+    int outstanding;
+    bool stopping;
+    int event_fd;               // Signals the main loop that jobs completed
+} pool = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER,
+           .event_fd = -1 };
+
+static void queue_push(WorkerQueue *q, WorkerJob *job) {
+    job->next = NULL;
+    if (q->tail)
+        q->tail->next = job;
+    else
+        q->head = job;
+    q->tail = job;
+}
+
+static WorkerJob *queue_pop(WorkerQueue *q) {
+    WorkerJob *job = q->head;
+    if (job) {
+        q->head = job->next;
+        if (!q->head)
+            q->tail = NULL;
+    }
+    return job;
+}
+
+/* Returns true when the list was empty, i.e. the main loop needs a wakeup */
+static bool completed_push(WorkerJob *job) {
+    WorkerJob *head = atomic_load_explicit(&pool.completed, memory_order_relaxed);
+    do {
+        job->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&pool.completed, &head, job,
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+    return head == NULL;
+}
+
+/* Take every finished job, oldest first */
+static WorkerJob *completed_take_all(void) {
+    WorkerJob *job = atomic_exchange_explicit(&pool.completed, NULL, memory_order_acquire);
+    WorkerJob *ordered = NULL;
+    while (job) {
+        WorkerJob *next = job->next;
+        job->next = ordered;
+        ordered = job;
+        job = next;
+    }
+    return ordered;
+}
+
+static void *worker_thread(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        while (!pool.pending.head && !pool.stopping)
+            pthread_cond_wait(&pool.wake, &pool.lock);
+        WorkerJob *job = queue_pop(&pool.pending);
+        if (!job)
+            break;
+        pthread_mutex_unlock(&pool.lock);
+
+        TRACE_PHASE(job->name, job->result = job->func(job->data));
+
+        // Only the push onto an empty list wakes the main loop; later ones
+        // are picked up by the same dispatch
+        if (completed_push(job)) {
+            uint64_t one = 1;
+            if (write(pool.event_fd, &one, sizeof(one)) < 0)
+                LOG_WARN("Cannot signal job completion: %s", strerror(errno));
+        }
+
+        pthread_mutex_lock(&pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+/* Hand finished jobs to their done callbacks, oldest first */
+static void deliver(WorkerJob *jobs) {
+    while (jobs) {
+        WorkerJob *next = jobs->next;
+        if (jobs->done)
+            jobs->done(jobs->result);
+        pool.outstanding--;
+        free(jobs);
+        jobs = next;
+    }
+}
+
+/* Publish finished jobs; runs on the main thread from the event loop */
+static void worker_pool_dispatch(int fd, void *data) {
+    (void)data;
+    // Clear the eventfd before taking the list: a job pushed in between
+    // then signals again instead of waiting for the next wakeup
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        return;
+
+    deliver(completed_take_all());
+}
+
+bool worker_pool_init(void) {
+    pool.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (pool.event_fd < 0) {
+        LOG_ERROR("Cannot create worker pool eventfd: %s", strerror(errno));
+        return false;
+    }
+    event_loop_add_fd(pool.event_fd, worker_pool_dispatch, NULL);
+
+    // Workers inherit a fully blocked signal mask so SIGTERM, SIGCHLD and
+    // friends keep going to the main thread
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+
+    pool.stopping = false;
+    for (int i = 0; i < WORKER_POOL_THREADS; i++) {
+        if (pthread_create(&pool.threads[pool.num_threads], NULL, worker_thread, NULL) != 0) {
+            LOG_WARN("Cannot start worker thread %d.", i);
+            break;
+        }
+        pool.num_threads++;
+    }
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    return pool.num_threads > 0;
+}
+
+/*
+ * Waits for queued jobs to finish and delivers every undelivered result, so
+ * done callbacks can release what their jobs produced.
+ */
+void worker_pool_cleanup(void) {
+    pthread_mutex_lock(&pool.lock);
+    pool.stopping = true;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (int i = 0; i < pool.num_threads; i++)
+        pthread_join(pool.threads[i], NULL);
+    pool.num_threads = 0;
+
+    deliver(completed_take_all());
+    pool.outstanding = 0;
+
+    if (pool.event_fd >= 0) {
+        event_loop_remove_fd(pool.event_fd);
+        close(pool.event_fd);
+        pool.event_fd = -1;
+    }
+}
+
+/* Without worker threads the job runs inline, so callers need no fallback */
+bool worker_pool_submit(const char *name, WorkerFunc func, WorkerDoneFunc done, void *data) {
+    if (pool.num_threads == 0) {
+        void *result;
+        TRACE_PHASE(name, result = func(data));
+        if (done)
+            done(result);
+        return true;
+    }
+
+    WorkerJob *job = calloc(1, sizeof(*job));
+    if (!job)
+        return false;
+    job->name = name;
+    job->func = func;
+    job->done = done;
+    job->data = data;
+
+    pool.outstanding++;
+    pthread_mutex_lock(&pool.lock);
+    queue_push(&pool.pending, job);
+    pthread_cond_signal(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+    return true;
+}
+
+int worker_pool_pending(void) {
+    return pool.outstanding;
+}
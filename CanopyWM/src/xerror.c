@@ -0,0 +1,149 @@
+// src/xerror.c
+#include "xerror.h"
+#include "wm.h"
+#include "log.h"
+#include <X11/Xproto.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// An error as read by Xlib, waiting for xerror_flush()
+typedef struct {
+    _Atomic bool ready;                // Set once the producer has filled it in
+    unsigned long serial;
+    XID resourceid;
+    unsigned char error_code;
+    unsigned char request_code;
+} XErrorRecord;
+
+static struct {
+    struct {
+        unsigned long serial;          // First request made for the client
+        ClientHandle client;
+    } marks[XERROR_MARKS];
+    unsigned int next_mark;
+
+    // Filled by handle_error() on whichever thread reads the error, drained
+    // by xerror_flush() on the main thread
+    XErrorRecord records[XERROR_MAX_RECORDS];
+    _Atomic unsigned long head;        // Next record to drain
+    _Atomic unsigned long tail;        // Next record to fill
+    _Atomic unsigned long lost;        // Errors that found the buffer full
+
+    unsigned long by_request[256];
+    unsigned long by_error[256];
+    unsigned long total;
+    unsigned long attributed;          // Matched to a client
+    unsigned long dropped;             // Clients removed because their window was gone
+} xerr;
+
+/* The client the request with this serial was made for, from the newest mark before it */
+static Client *owner_by_serial(unsigned long serial) {
+    unsigned long best = 0;
+    ClientHandle owner = CLIENT_HANDLE_NONE;
+    for (int i = 0; i < XERROR_MARKS; i++) {
+        if (xerr.marks[i].client != CLIENT_HANDLE_NONE &&
+            xerr.marks[i].serial <= serial && xerr.marks[i].serial >= best) {
+            best = xerr.marks[i].serial;
+            owner = xerr.marks[i].client;
+        }
+    }
+    return client_from_handle(owner);
+}
+
+/*
+ * Called from inside Xlib, on the main thread or a worker (XOpenIM and
+ * XCreateIC run on one), so it only copies the error into the buffer; the
+ * client slab and the counters are left to xerror_flush().
+ */
+static int handle_error(Display *dpy, XErrorEvent *e) {
+    (void)dpy;
+    if (e->request_code == X_ChangeWindowAttributes && e->error_code == BadAccess &&
+        e->resourceid == wm.root) {
+        LOG_ERROR("Another window manager is already running.");
+        exit(1);
+    }
+
+    unsigned long tail = atomic_load(&xerr.tail);
+    do {
+        if (tail - atomic_load(&xerr.head) >= XERROR_MAX_RECORDS) {
+            atomic_fetch_add(&xerr.lost, 1);
+            return 0;
+        }
+    } while (!atomic_compare_exchange_weak(&xerr.tail, &tail, tail + 1));
+
+    XErrorRecord *r = &xerr.records[tail % XERROR_MAX_RECORDS];
+    r->serial = e->serial;
+    r->resourceid = e->resourceid;
+    r->error_code = e->error_code;
+    r->request_code = e->request_code;
+    atomic_store_explicit(&r->ready, true, memory_order_release);
+    return 0;
+}
+
+/* Count an error and attribute it; drops the client if its window is gone */
+static void process(const XErrorRecord *r) {
+    xerr.total++;
+    xerr.by_request[r->request_code]++;
+    xerr.by_error[r->error_code]++;
+
+    Client *c = client_find_by_window(r->resourceid);
+    if (!c)
+        c = owner_by_serial(r->serial);
+    if (!c)
+        return;
+
+    xerr.attributed++;
+    if ((r->error_code == BadWindow || r->error_code == BadDrawable) &&
+        r->resourceid == c->window) {
+        LOG_INFO("Window 0x%lx is gone, unmanaging it.", c->window);
+        client_remove(c->window);
+        xerr.dropped++;
+    }
+}
+
+void xerror_init(Display *dpy) {
+    (void)dpy;
+    XSetErrorHandler(handle_error);
+}
+
+void xerror_mark(const Client *client) {
+    xerr.marks[xerr.next_mark].serial = NextRequest(wm.display);
+    xerr.marks[xerr.next_mark].client = client_handle(client);
+    xerr.next_mark = (xerr.next_mark + 1) % XERROR_MARKS;
+}
+
+void xerror_flush(void) {
+    unsigned long head = atomic_load(&xerr.head);
+    for (;;) {
+        XErrorRecord *r = &xerr.records[head % XERROR_MAX_RECORDS];
+        if (!atomic_load_explicit(&r->ready, memory_order_acquire))
+            break;      // Empty, or claimed but not filled in yet
+        XErrorRecord copy = *r;
+        atomic_store_explicit(&r->ready, false, memory_order_relaxed);
+        atomic_store_explicit(&xerr.head, ++head, memory_order_release);
+        process(&copy);
+    }
+}
+
+void xerror_dump_stats(void) {
+    LOG_INFO("X errors: %lu total, %lu attributed to clients, %lu clients dropped, "
+             "%lu lost to a full buffer", xerr.total, xerr.attributed, xerr.dropped,
+             (unsigned long)atomic_load(&xerr.lost));
+    for (int i = 0; i < 256; i++) {
+        if (!xerr.by_request[i])
+            continue;
+        char number[8], name[64];
+        snprintf(number, sizeof(number), "%d", i);
+        XGetErrorDatabaseText(wm.display, "XRequest", number, number, name, sizeof(name));
+        LOG_INFO("  request %-24s %lu", name, xerr.by_request[i]);
+    }
+    for (int i = 0; i < 256; i++) {
+        if (!xerr.by_error[i])
+            continue;
+        char name[64];
+        XGetErrorText(wm.display, i, name, sizeof(name));
+        LOG_INFO("  error   %-24s %lu", name, xerr.by_error[i]);
+    }
+}
@@ -0,0 +1,129 @@
+// src/xstats.c
+#include "xstats.h"
+#include "wm.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdint.h>
+
+typedef struct {
+    const char *file;                  // NULL for a free entry
+    int line;
+    const char *call;
+    uint64_t round_trips;
+    int last_source;                   // Source active during the latest round trip, or -1
+} XStatsSite;
+
+static struct {
+    XStatsSource sources[XSTATS_SOURCES];
+    XStatsSite sites[XSTATS_MAX_SITES];
+    uint64_t round_trips;
+    uint64_t untracked;                // Round trips from sites that did not fit the table
+    int current;                       // Source between xstats_begin() and xstats_end(), or -1
+    unsigned long start_request;
+    uint64_t start_round_trips;
+} xs = { .current = -1 };
+
+static const char *event_names[LASTEvent] = {
+    [KeyPress] = "KeyPress", [KeyRelease] = "KeyRelease",
+    [ButtonPress] = "ButtonPress", [ButtonRelease] = "ButtonRelease",
+    [MotionNotify] = "MotionNotify", [EnterNotify] = "EnterNotify",
+    [LeaveNotify] = "LeaveNotify", [FocusIn] = "FocusIn", [FocusOut] = "FocusOut",
+    [KeymapNotify] = "KeymapNotify", [Expose] = "Expose",
+    [GraphicsExpose] = "GraphicsExpose", [NoExpose] = "NoExpose",
+    [VisibilityNotify] = "VisibilityNotify", [CreateNotify] = "CreateNotify",
+    [DestroyNotify] = "DestroyNotify", [UnmapNotify] = "UnmapNotify",
+    [MapNotify] = "MapNotify", [MapRequest] = "MapRequest",
+    [ReparentNotify] = "ReparentNotify", [ConfigureNotify] = "ConfigureNotify",
+    [ConfigureRequest] = "ConfigureRequest", [GravityNotify] = "GravityNotify",
+    [ResizeRequest] = "ResizeRequest", [CirculateNotify] = "CirculateNotify",
+    [CirculateRequest] = "CirculateRequest", [PropertyNotify] = "PropertyNotify",
+    [SelectionClear] = "SelectionClear", [SelectionRequest] = "SelectionRequest",
+    [SelectionNotify] = "SelectionNotify", [ColormapNotify] = "ColormapNotify",
+    [ClientMessage] = "ClientMessage", [MappingNotify] = "MappingNotify",
+    [GenericEvent] = "GenericEvent",
+};
+
+const char *xstats_source_name(int source, char *buf, size_t size) {
+    if (source == XSTATS_SOURCE_IPC)
+        return "ipc";
+    if (source == XSTATS_SOURCE_LOOP)
+        return "loop";
+    if (source < LASTEvent && event_names[source])
+        return event_names[source];
+    if (wm.randr_event_base >= 0 && source == wm.randr_event_base)
+        return "RRScreenChangeNotify";
+    snprintf(buf, size, "event %d", source);
+    return buf;
+}
+
+void xstats_round_trip(const char *file, int line, const char *call) {
+    xs.round_trips++;
+
+    uintptr_t hash = ((uintptr_t)file >> 4) ^ ((uintptr_t)line * 2654435761u);
+    for (int probe = 0; probe < XSTATS_MAX_SITES; probe++) {
+        XStatsSite *site = &xs.sites[(hash + probe) % XSTATS_MAX_SITES];
+        if (!site->file) {
+            site->file = file;
+            site->line = line;
+            site->call = call;
+        } else if (site->file != file || site->line != line) {
+            continue;
+        }
+        site->round_trips++;
+        site->last_source = xs.current;
+        return;
+    }
+    xs.untracked++;
+}
+
+void xstats_begin(int source) {
+    if (source < 0 || source >= XSTATS_SOURCES)
+        source = XSTATS_SOURCE_LOOP;
+    xs.current = source;
+    xs.start_request = NextRequest(wm.display);
+    xs.start_round_trips = xs.round_trips;
+}
+
+void xstats_end(void) {
+    if (xs.current < 0)
+        return;
+    XStatsSource *s = &xs.sources[xs.current];
+    s->count++;
+    s->requests += NextRequest(wm.display) - xs.start_request;
+    s->round_trips += xs.round_trips - xs.start_round_trips;
+    xs.current = -1;
+}
+
+const XStatsSource *xstats_source(int source) {
+    if (source < 0 || source >= XSTATS_SOURCES)
+        return NULL;
+    return &xs.sources[source];
+}
+
+void xstats_dump_stats(void) {
+    char buf[32];
+    LOG_INFO("X requests by source (%llu round trips in total):",
+             (unsigned long long)xs.round_trips);
+    for (int i = 0; i < XSTATS_SOURCES; i++) {
+        const XStatsSource *s = &xs.sources[i];
+        if (s->count == 0)
+            continue;
+        LOG_INFO("  %-20s count=%llu requests=%llu (%.2f each) round_trips=%llu (%.2f each)",
+                 xstats_source_name(i, buf, sizeof(buf)), (unsigned long long)s->count,
+                 (unsigned long long)s->requests, (double)s->requests / s->count,
+                 (unsigned long long)s->round_trips, (double)s->round_trips / s->count);
+    }
+
+    LOG_INFO("Round trips by call site:");
+    for (int i = 0; i < XSTATS_MAX_SITES; i++) {
+        const XStatsSite *site = &xs.sites[i];
+        if (!site->file)
+            continue;
+        LOG_INFO("  %s:%d %-40.40s %llu (last from %s)", site->file, site->line, site->call,
+                 (unsigned long long)site->round_trips,
+                 site->last_source < 0 ? "startup" :
+                 xstats_source_name(site->last_source, buf, sizeof(buf)));
+    }
+    if (xs.untracked)
+        LOG_INFO("  (untracked sites) %llu", (unsigned long long)xs.untracked);
+}
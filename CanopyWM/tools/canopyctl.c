@@ -0,0 +1,242 @@
+// tools/canopyctl.c
+//
+// Command line client for the CanopyWM control socket: sends one command
+// and prints the reply, or subscribes and prints events until interrupted.
+#include "ipc_protocol.h"
+#include "wm_events.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const char *event_names[] = {
+    [WM_EVENT_CLIENT_ADD] = "add",
+    [WM_EVENT_CLIENT_REMOVE] = "remove",
+    [WM_EVENT_CLIENT_TITLE] = "title",
+    [WM_EVENT_CLIENT_FOCUS] = "focus",
+    [WM_EVENT_CLIENT_URGENT] = "urgent",
+    [WM_EVENT_RESET] = "reset",
+    [WM_EVENT_CLIENT_NOT_RESPONDING] = "hung",
+};
+
+#define NUM_EVENT_NAMES (sizeof(event_names) / sizeof(event_names[0]))
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: canopyctl focus WINDOW\n"
+            "       canopyctl move WINDOW X Y\n"
+            "       canopyctl close WINDOW\n"
+            "       canopyctl workspace INDEX\n"
+            "       canopyctl reload\n"
+            "       canopyctl xstats\n"
+            "       canopyctl pings\n"
+            "       canopyctl subscribe [add,remove,title,focus,urgent,reset,hung]\n");
+    exit(2);
+}
+
+static int connect_wm(void) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    ipc_socket_path(addr.sun_path, sizeof(addr.sun_path));
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "canopyctl: cannot connect to %s: %s\n", addr.sun_path, strerror(errno));
+        exit(1);
+    }
+    return fd;
+}
+
+static bool read_full(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static void send_message(int fd, uint16_t type, const void *payload, uint32_t len) {
+    char buf[sizeof(IpcHeader) + IPC_MAX_PAYLOAD];
+    IpcHeader header = { .length = len, .type = type };
+    memcpy(buf, &header, sizeof(header));
+    if (len) memcpy(buf + sizeof(header), payload, len);
+    if (write(fd, buf, sizeof(header) + len) != (ssize_t)(sizeof(header) + len)) {
+        fprintf(stderr, "canopyctl: write failed: %s\n", strerror(errno));
+        exit(1);
+    }
+}
+
+/* Next message from the WM; the payload is malloc'd */
+static char *receive_message(int fd, IpcHeader *header) {
+    if (!read_full(fd, header, sizeof(*header)))
+        return NULL;
+    char *payload = malloc(header->length ? header->length : 1);
+    if (!payload || !read_full(fd, payload, header->length)) {
+        free(payload);
+        return NULL;
+    }
+    return payload;
+}
+
+static void print_xstats(const char *payload, uint32_t len) {
+    printf("%-24s %10s %10s %8s %10s %8s\n",
+           "source", "count", "requests", "each", "roundtrips", "each");
+    for (uint32_t pos = 0; pos + sizeof(IpcXStats) <= len; pos += sizeof(IpcXStats)) {
+        IpcXStats s;
+        memcpy(&s, payload + pos, sizeof(s));
+        s.name[sizeof(s.name) - 1] = '\0';
+        printf("%-24s %10llu %10llu %8.2f %10llu %8.2f\n", s.name,
+               (unsigned long long)s.count, (unsigned long long)s.requests,
+               s.count ? (double)s.requests / s.count : 0.0,
+               (unsigned long long)s.round_trips,
+               s.count ? (double)s.round_trips / s.count : 0.0);
+    }
+}
+
+/* Upper bound in ms of the bucket holding the given fraction of replies */
+static unsigned long ping_percentile(const IpcPingStats *s, double fraction) {
+    unsigned long seen = 0;
+    for (int i = 0; i < IPC_PING_BUCKETS; i++) {
+        seen += s->buckets[i];
+        if (s->replies && seen >= fraction * s->replies)
+            return 1ul << i;
+    }
+    return 0;
+}
+
+static void print_pings(const char *payload, uint32_t len) {
+    printf("%-24s %8s %8s %8s %8s %8s\n", "app", "replies", "timeouts", "p50<ms", "p99<ms", "max ms");
+    for (uint32_t pos = 0; pos + sizeof(IpcPingStats) <= len; pos += sizeof(IpcPingStats)) {
+        IpcPingStats s;
+        memcpy(&s, payload + pos, sizeof(s));
+        s.app[sizeof(s.app) - 1] = '\0';
+        printf("%-24s %8u %8u %8lu %8lu %8u\n", s.app, s.replies, s.timeouts,
+               ping_percentile(&s, 0.5), ping_percentile(&s, 0.99), s.max_ms);
+    }
+}
+
+static int wait_reply(int fd) {
+    IpcHeader header;
+    char *payload;
+    while ((payload = receive_message(fd, &header))) {
+        if (header.type == IPC_MSG_REPLY && header.length == sizeof(int32_t)) {
+            int32_t status;
+            memcpy(&status, payload, sizeof(status));
+            free(payload);
+            return status;
+        }
+        if (header.type == IPC_MSG_XSTATS_DATA)
+            print_xstats(payload, header.length);
+        else if (header.type == IPC_MSG_PING_STATS_DATA)
+            print_pings(payload, header.length);
+        free(payload);
+    }
+    fprintf(stderr, "canopyctl: connection closed by the WM\n");
+    exit(1);
+}
+
+static uint32_t parse_window(const char *arg) {
+    char *end;
+    unsigned long window = strtoul(arg, &end, 0);
+    if (*end || window == 0) usage();
+    return (uint32_t)window;
+}
+
+static uint32_t parse_mask(const char *arg) {
+    if (!arg) return IPC_EVENT_ALL;
+
+    uint32_t mask = 0;
+    char *list = strdup(arg);
+    for (char *name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+        size_t i;
+        for (i = 1; i < NUM_EVENT_NAMES; i++) {
+            if (strcmp(name, event_names[i]) == 0) break;
+        }
+        if (i == NUM_EVENT_NAMES) {
+            fprintf(stderr, "canopyctl: unknown event type '%s'\n", name);
+            exit(2);
+        }
+        mask |= IPC_EVENT_MASK(i);
+    }
+    free(list);
+    return mask;
+}
+
+static void print_events(const char *payload, uint32_t len) {
+    for (uint32_t pos = 0; pos + sizeof(IpcEvent) <= len; ) {
+        IpcEvent ev;
+        memcpy(&ev, payload + pos, sizeof(ev));
+        const char *name = ev.type < NUM_EVENT_NAMES && event_names[ev.type] ?
+                           event_names[ev.type] : "?";
+        printf("%s 0x%x %u", name, ev.window, ev.value);
+        if (ev.title_len)
+            printf(" %.*s", (int)ev.title_len, payload + pos + sizeof(ev));
+        putchar('\n');
+        pos += sizeof(ev) + ev.title_len;
+    }
+}
+
+static int subscribe(int fd, uint32_t mask) {
+    send_message(fd, IPC_MSG_SUBSCRIBE, &mask, sizeof(mask));
+
+    IpcHeader header;
+    char *payload;
+    while ((payload = receive_message(fd, &header))) {
+        if (header.type == IPC_MSG_EVENTS) {
+            print_events(payload, header.length);
+        } else if (header.type == IPC_MSG_GAP && header.length == sizeof(uint32_t)) {
+            uint32_t dropped;
+            memcpy(&dropped, payload, sizeof(dropped));
+            printf("gap %u\n", dropped);
+        }
+        free(payload);
+        fflush(stdout);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) usage();
+    const char *cmd = argv[1];
+    int fd = connect_wm();
+
+    if (strcmp(cmd, "subscribe") == 0) {
+        if (argc > 3) usage();
+        return subscribe(fd, parse_mask(argc == 3 ? argv[2] : NULL));
+    }
+
+    if ((strcmp(cmd, "focus") == 0 || strcmp(cmd, "close") == 0) && argc == 3) {
+        IpcWindowArg arg = { parse_window(argv[2]) };
+        send_message(fd, cmd[0] == 'f' ? IPC_MSG_FOCUS : IPC_MSG_CLOSE, &arg, sizeof(arg));
+    } else if (strcmp(cmd, "move") == 0 && argc == 5) {
+        IpcMoveArg arg = { parse_window(argv[2]), atoi(argv[3]), atoi(argv[4]) };
+        send_message(fd, IPC_MSG_MOVE, &arg, sizeof(arg));
+    } else if (strcmp(cmd, "workspace") == 0 && argc == 3) {
+        uint32_t index = (uint32_t)strtoul(argv[2], NULL, 0);
+        send_message(fd, IPC_MSG_WORKSPACE, &index, sizeof(index));
+    } else if (strcmp(cmd, "reload") == 0 && argc == 2) {
+        send_message(fd, IPC_MSG_RELOAD, NULL, 0);
+    } else if (strcmp(cmd, "xstats") == 0 && argc == 2) {
+        send_message(fd, IPC_MSG_XSTATS, NULL, 0);
+    } else if (strcmp(cmd, "pings") == 0 && argc == 2) {
+        send_message(fd, IPC_MSG_PING_STATS, NULL, 0);
+    } else {
+        usage();
+    }
+
+    int32_t status = wait_reply(fd);
+    switch (status) {
+    case IPC_OK: return 0;
+    case IPC_ERR_NO_WINDOW: fprintf(stderr, "canopyctl: not a managed window\n"); break;
+    case IPC_ERR_UNSUPPORTED: fprintf(stderr, "canopyctl: not supported by this WM\n"); break;
+    default: fprintf(stderr, "canopyctl: request failed (%d)\n", status); break;
+    }
+    return 1;
+}
@@ -0,0 +1,77 @@
+// tools/gen_config_keys.c
+//
+// Build-time generator for config_key_table.h: finds an FNV-1a seed that
+// maps every option in config_keys.def to a distinct slot and prints the
+// resulting table, indexed by slot.
+#include "config_keys.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+static const struct {
+    const char *section;
+    const char *name;
+    const char *field;
+    const char *type;
+} keys[] = {
+#define CONFIG_KEY(section, name, field, type) { section, name, #field, #type },
+#include "config_keys.def"
+#undef CONFIG_KEY
+};
+
+#define NUM_KEYS (sizeof(keys) / sizeof(keys[0]))
+#define MAX_SLOTS 1024
+#define MAX_ATTEMPTS 1000000
+
+static uint32_t key_slot(uint32_t seed, size_t i, uint32_t slots) {
+    IniStr section = { keys[i].section, strlen(keys[i].section) };
+    IniStr name = { keys[i].name, strlen(keys[i].name) };
+    return config_key_hash(seed, section, name) & (slots - 1);
+}
+
+static bool try_seed(uint32_t seed, uint32_t slots, int *table) {
+    for (uint32_t s = 0; s < slots; s++)
+        table[s] = -1;
+    for (size_t i = 0; i < NUM_KEYS; i++) {
+        uint32_t s = key_slot(seed, i, slots);
+        if (table[s] >= 0)
+            return false;
+        table[s] = (int)i;
+    }
+    return true;
+}
+
+int main(void) {
+    static int table[MAX_SLOTS];
+    uint32_t slots = 1;
+    while (slots < 2 * NUM_KEYS)
+        slots <<= 1;
+
+    for (; slots <= MAX_SLOTS; slots <<= 1) {
+        for (uint32_t attempt = 0; attempt < MAX_ATTEMPTS; attempt++) {
+            uint32_t seed = 2166136261u + attempt;
+            if (!try_seed(seed, slots, table))
+                continue;
+
+            printf("/* Generated by tools/gen_config_keys.c from config_keys.def. Do not edit. */\n");
+            printf("#ifndef CANOPY_CONFIG_KEY_TABLE_H\n#define CANOPY_CONFIG_KEY_TABLE_H\n\n");
+            printf("#include \"config.h\"\n#include \"config_keys.h\"\n\n");
+            printf("#define CONFIG_KEY_SEED 0x%08xu\n", seed);
+            printf("#define CONFIG_KEY_SLOTS %u\n\n", slots);
+            printf("static const ConfigKey config_key_table[CONFIG_KEY_SLOTS] = {\n");
+            for (uint32_t s = 0; s < slots; s++) {
+                if (table[s] < 0) continue;
+                int i = table[s];
+                printf("    [%u] = { \"%s\", \"%s\", %zu, %zu, CONFIG_KEY_%s, offsetof(Config, %s) },\n",
+                       s, keys[i].section, keys[i].name,
+                       strlen(keys[i].section), strlen(keys[i].name),
+                       keys[i].type, keys[i].field);
+            }
+            printf("};\n\n#endif\n");
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "gen_config_keys: no collision-free seed found\n");
+    return 1;
+}